@@ -3,6 +3,8 @@
 #include "unzipper.h"
 #include "zipper.h"
 #include "formatter.h"
+#include "graph.h"
+#include "worker.h"
 
 using namespace v8;
 using namespace node;
@@ -14,8 +16,16 @@ void Init(Handle<Object> exports) {
   Unzipper::Init(exports);
   Zipper::Init(exports);
   Formatter::Init(exports);
+  Graph::Init(exports);
+  WorkerPool::Init(exports);
 }
 
 }
 
-NODE_MODULE(binding, pcmutils::Init)
\ No newline at end of file
+// Context aware, so every environment (the main thread and each
+// worker_thread) gets its own classes bound to its own isolate and loop.
+// The exported initializer is also how node finds the addon again when a
+// worker loads it after the main thread already has.
+NODE_MODULE_INIT() {
+  pcmutils::Init(exports);
+}
@@ -2,7 +2,7 @@
   "targets": [
     {
       "target_name": "binding",
-      "sources": [ "binding.cc", "mixer.cc", "unzipper.cc", "zipper.cc", "formatter.cc" ]
+      "sources": [ "binding.cc", "mixer.cc", "unzipper.cc", "zipper.cc", "formatter.cc", "graph.cc", "pool.cc", "worker.cc", "carry.cc", "shard.cc", "fifo.cc", "cpu.cc", "codecs.cc", "convert.cc", "interleave.cc", "mix.cc" ]
     }
   ]
 }
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "carry.h"
+
+using namespace pcmutils;
+
+CarryBuffer::CarryBuffer(size_t alignment_) : alignment(alignment_), length(0), data(NULL) {
+  data = (char*)malloc(alignment);
+}
+
+CarryBuffer::~CarryBuffer() {
+  free(data);
+  data = NULL;
+  length = 0;
+}
+
+bool CarryBuffer::Split(const char* chunk, size_t chunkLength, char* head, size_t* skip, size_t* frames) {
+  bool stitched = false;
+  *skip = 0;
+
+  if (length > 0) {
+    size_t need = alignment - length;
+
+    // Still not a whole frame, keep collecting.
+    if (chunkLength < need) {
+      memcpy(data + length, chunk, chunkLength);
+      length += chunkLength;
+      *skip = chunkLength;
+      *frames = 0;
+      return false;
+    }
+
+    memcpy(head, data, length);
+    memcpy(head + length, chunk, need);
+    length = 0;
+    *skip = need;
+    stitched = true;
+  }
+
+  size_t body = chunkLength - *skip;
+  *frames = body / alignment;
+  length = body % alignment;
+  memcpy(data, chunk + chunkLength - length, length);
+  return stitched;
+}
@@ -0,0 +1,32 @@
+#ifndef CARRY_H
+#define CARRY_H
+
+#include <cstdlib>
+#include <cstring>
+
+namespace pcmutils {
+
+// Holds the partial frame left at the end of one chunk until the next
+// chunk completes it, so streams can be split at any byte. Only touched on
+// the loop thread, in submission order.
+class CarryBuffer {
+public:
+  CarryBuffer(size_t alignment_);
+  ~CarryBuffer();
+
+  // Splits the next chunk at whole frames. When the carried bytes can be
+  // completed from the start of the chunk, the stitched frame is written to
+  // `head` (one frame long) and true is returned. The chunk's whole frames
+  // start at `*skip`, and its trailing partial frame is carried over.
+  bool Split(const char* chunk, size_t chunkLength, char* head, size_t* skip, size_t* frames);
+
+  size_t alignment;
+  size_t length;
+
+protected:
+  char* data;
+};
+
+}
+
+#endif
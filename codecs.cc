@@ -0,0 +1,86 @@
+#include <uv.h>
+#include "codecs.h"
+
+using namespace pcmutils;
+
+int16_t pcmutils::ulawDecode[256];
+int16_t pcmutils::alawDecode[256];
+uint8_t pcmutils::ulawEncode[1 << 14];
+uint8_t pcmutils::alawEncode[1 << 13];
+
+// Reference G.711 conversions, only used to build the tables.
+
+static int Segment(int value, const int* ends) {
+  for (int seg = 0; seg < 8; seg++) {
+    if (value <= ends[seg]) return seg;
+  }
+  return 8;
+}
+
+static int16_t UlawToLinear(uint8_t code) {
+  code = ~code;
+  int t = (((code & 0x0F) << 3) + 0x84) << ((code & 0x70) >> 4);
+  return static_cast<int16_t>((code & 0x80) ? 0x84 - t : t - 0x84);
+}
+
+static uint8_t LinearToUlaw(int pcm) {
+  static const int ends[8] = { 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF, 0x1FFF };
+  int mask = 0xFF;
+  if (pcm < 0) {
+    pcm = -pcm;
+    mask = 0x7F;
+  }
+  if (pcm > 8159) pcm = 8159;
+  pcm += 0x21;
+
+  int seg = Segment(pcm, ends);
+  if (seg >= 8) return static_cast<uint8_t>(0x7F ^ mask);
+  return static_cast<uint8_t>(((seg << 4) | ((pcm >> (seg + 1)) & 0x0F)) ^ mask);
+}
+
+static int16_t AlawToLinear(uint8_t code) {
+  code ^= 0x55;
+  int t = (code & 0x0F) << 4;
+  int seg = (code & 0x70) >> 4;
+  if (seg == 0) {
+    t += 8;
+  } else {
+    t = (t + 0x108) << (seg - 1);
+  }
+  return static_cast<int16_t>((code & 0x80) ? t : -t);
+}
+
+static uint8_t LinearToAlaw(int pcm) {
+  static const int ends[8] = { 0x1F, 0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF, 0x7FF, 0xFFF };
+  int mask = 0xD5;
+  if (pcm < 0) {
+    pcm = -pcm - 1;
+    mask = 0x55;
+  }
+
+  int seg = Segment(pcm, ends);
+  if (seg >= 8) return static_cast<uint8_t>(0x7F ^ mask);
+  int aval = (seg << 4) | ((pcm >> (seg < 2 ? 1 : seg)) & 0x0F);
+  return static_cast<uint8_t>(aval ^ mask);
+}
+
+static void BuildCodecTables() {
+  for (int code = 0; code < 256; code++) {
+    ulawDecode[code] = UlawToLinear(static_cast<uint8_t>(code));
+    alawDecode[code] = AlawToLinear(static_cast<uint8_t>(code));
+  }
+
+  // Indices are the truncated two's complement sample, sign-extend them back.
+  for (int i = 0; i < (1 << 14); i++) {
+    ulawEncode[i] = LinearToUlaw(i < (1 << 13) ? i : i - (1 << 14));
+  }
+  for (int i = 0; i < (1 << 13); i++) {
+    alawEncode[i] = LinearToAlaw(i < (1 << 12) ? i : i - (1 << 13));
+  }
+}
+
+// Modules load once per environment, possibly on several threads at once.
+void pcmutils::InitCodecTables() {
+  static uv_once_t once = UV_ONCE_INIT;
+  uv_once(&once, BuildCodecTables);
+}
@@ -0,0 +1,276 @@
+#ifndef CODECS_H
+#define CODECS_H
+
+#include <stdint.h>
+#include <cstring>
+
+namespace pcmutils {
+
+// Mirrors the FMT_* constants exported from constants.coffee.
+enum {
+  FMT_F32LE = 0,
+  FMT_F32BE = 1,
+  FMT_S16LE = 2,
+  FMT_S16BE = 3,
+  FMT_U16LE = 4,
+  FMT_U16BE = 5,
+  FMT_S24LE = 6,
+  FMT_S24BE = 7,
+  FMT_S32LE = 8,
+  FMT_S32BE = 9,
+  FMT_F64LE = 10,
+  FMT_F64BE = 11,
+  FMT_U8 = 12,
+  FMT_ULAW = 13,
+  FMT_ALAW = 14,
+  FMT_COUNT = 15
+};
+
+// Sample codecs. Each one knows how to read and write a single sample of
+// its format, either as a float in [-1, 1) or as a left-justified 32-bit
+// integer. Big-endian codecs swap bytes as part of the load and store, so
+// there is never a separate swapping pass. Codecs marked `wide` carry more
+// precision than a float and also convert through double.
+
+static inline uint16_t ByteSwap(uint16_t value) {
+  return static_cast<uint16_t>((value << 8) | (value >> 8));
+}
+
+static inline uint32_t ByteSwap(uint32_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_bswap32(value);
+#else
+  return (value << 24) | ((value << 8) & 0x00FF0000) | ((value >> 8) & 0x0000FF00) | (value >> 24);
+#endif
+}
+
+static inline uint64_t ByteSwap(uint64_t value) {
+#if defined(__GNUC__) || defined(__clang__)
+  return __builtin_bswap64(value);
+#else
+  return (static_cast<uint64_t>(ByteSwap(static_cast<uint32_t>(value))) << 32) | ByteSwap(static_cast<uint32_t>(value >> 32));
+#endif
+}
+
+template <typename T, bool BE>
+static inline T LoadSample(const char* in) {
+  T value;
+  memcpy(&value, in, sizeof(T));
+  if (BE) value = ByteSwap(value);
+  return value;
+}
+
+template <typename T, bool BE>
+static inline void StoreSample(char* out, T value) {
+  if (BE) value = ByteSwap(value);
+  memcpy(out, &value, sizeof(T));
+}
+
+// The low clamp is written so NaN fails it too and lands on the minimum,
+// as it does in the SIMD kernels' max/min, instead of reaching an
+// undefined float to int conversion.
+static inline int16_t FloatToS16(float value) {
+  float scaled = value * 32767.0f;
+  scaled = !(scaled > -32768.0f) ? -32768.0f : scaled;
+  scaled = scaled > 32767.0f ? 32767.0f : scaled;
+  return static_cast<int16_t>(scaled);
+}
+
+static inline int32_t FloatToS24(float value) {
+  float scaled = value * 8388607.0f;
+  scaled = !(scaled > -8388608.0f) ? -8388608.0f : scaled;
+  scaled = scaled > 8388607.0f ? 8388607.0f : scaled;
+  return static_cast<int32_t>(scaled);
+}
+
+static inline int32_t DoubleToS32(double value) {
+  double scaled = value * 2147483647.0;
+  scaled = !(scaled > -2147483648.0) ? -2147483648.0 : scaled;
+  scaled = scaled > 2147483647.0 ? 2147483647.0 : scaled;
+  return static_cast<int32_t>(scaled);
+}
+
+// G.711 companding tables, filled in by InitCodecTables(). Decoding maps
+// a code to a 16-bit sample. Encoding is indexed by the top 14 (μ-law) or
+// 13 (A-law) bits of a 16-bit sample, the resolution each law works at.
+extern int16_t ulawDecode[256];
+extern int16_t alawDecode[256];
+extern uint8_t ulawEncode[1 << 14];
+extern uint8_t alawEncode[1 << 13];
+
+void InitCodecTables();
+
+template <bool BE>
+struct F32Codec {
+  static const int size = 4;
+  static const bool isFloat = true;
+  static const bool wide = false;
+  static inline float ToFloat(const char* in) {
+    uint32_t bits = LoadSample<uint32_t, BE>(in);
+    float value;
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+  }
+  static inline void FromFloat(float value, char* out) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(float));
+    StoreSample<uint32_t, BE>(out, bits);
+  }
+};
+
+template <bool BE>
+struct S16Codec {
+  static const int size = 2;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline float ToFloat(const char* in) { return static_cast<int16_t>(LoadSample<uint16_t, BE>(in)) / 32768.0f; }
+  static inline void FromFloat(float value, char* out) { StoreSample<uint16_t, BE>(out, static_cast<uint16_t>(FloatToS16(value))); }
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(static_cast<uint32_t>(LoadSample<uint16_t, BE>(in)) << 16); }
+  static inline void FromInt(int32_t value, char* out) { StoreSample<uint16_t, BE>(out, static_cast<uint32_t>(value) >> 16); }
+};
+
+template <bool BE>
+struct U16Codec {
+  static const int size = 2;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline float ToFloat(const char* in) { return (static_cast<int>(LoadSample<uint16_t, BE>(in)) - 32768) / 32768.0f; }
+  static inline void FromFloat(float value, char* out) { StoreSample<uint16_t, BE>(out, static_cast<uint16_t>(FloatToS16(value)) ^ 0x8000); }
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(static_cast<uint32_t>(LoadSample<uint16_t, BE>(in) ^ 0x8000) << 16); }
+  static inline void FromInt(int32_t value, char* out) { StoreSample<uint16_t, BE>(out, (static_cast<uint32_t>(value) >> 16) ^ 0x8000); }
+};
+
+// Packed 24-bit, assembled from bytes so unaligned input is never an issue.
+template <bool BE>
+struct S24Codec {
+  static const int size = 3;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline int32_t ToInt(const char* in) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(in);
+    uint32_t hi = b[BE ? 0 : 2], mid = b[1], lo = b[BE ? 2 : 0];
+    uint32_t value = (hi << 24) | (mid << 16) | (lo << 8);
+    return static_cast<int32_t>(value);
+  }
+  static inline void FromInt(int32_t value, char* out) {
+    uint32_t bits = static_cast<uint32_t>(value);
+    out[BE ? 0 : 2] = static_cast<char>(bits >> 24);
+    out[1] = static_cast<char>(bits >> 16);
+    out[BE ? 2 : 0] = static_cast<char>(bits >> 8);
+  }
+  static inline float ToFloat(const char* in) { return ToInt(in) / 2147483648.0f; }
+  static inline void FromFloat(float value, char* out) { FromInt(static_cast<int32_t>(static_cast<uint32_t>(FloatToS24(value)) << 8), out); }
+};
+
+template <bool BE>
+struct S32Codec {
+  static const int size = 4;
+  static const bool isFloat = false;
+  static const bool wide = true;
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(LoadSample<uint32_t, BE>(in)); }
+  static inline void FromInt(int32_t value, char* out) { StoreSample<uint32_t, BE>(out, static_cast<uint32_t>(value)); }
+  static inline float ToFloat(const char* in) { return ToInt(in) / 2147483648.0f; }
+  static inline void FromFloat(float value, char* out) { FromInt(DoubleToS32(value), out); }
+  static inline double ToDouble(const char* in) { return ToInt(in) / 2147483648.0; }
+  static inline void FromDouble(double value, char* out) { FromInt(DoubleToS32(value), out); }
+};
+
+template <bool BE>
+struct F64Codec {
+  static const int size = 8;
+  static const bool isFloat = true;
+  static const bool wide = true;
+  static inline double ToDouble(const char* in) {
+    uint64_t bits = LoadSample<uint64_t, BE>(in);
+    double value;
+    memcpy(&value, &bits, sizeof(double));
+    return value;
+  }
+  static inline void FromDouble(double value, char* out) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(double));
+    StoreSample<uint64_t, BE>(out, bits);
+  }
+  static inline float ToFloat(const char* in) { return static_cast<float>(ToDouble(in)); }
+  static inline void FromFloat(float value, char* out) { FromDouble(value, out); }
+};
+
+struct U8Codec {
+  static const int size = 1;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint8_t>(*in) ^ 0x80) << 24); }
+  static inline void FromInt(int32_t value, char* out) { *out = static_cast<char>((static_cast<uint32_t>(value) >> 24) ^ 0x80); }
+  static inline float ToFloat(const char* in) { return (static_cast<uint8_t>(*in) - 128) / 128.0f; }
+  static inline void FromFloat(float value, char* out) { FromInt(static_cast<int32_t>(static_cast<uint32_t>(FloatToS16(value)) << 16), out); }
+};
+
+struct ULawCodec {
+  static const int size = 1;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(ulawDecode[static_cast<uint8_t>(*in)])) << 16); }
+  static inline void FromInt(int32_t value, char* out) { *out = static_cast<char>(ulawEncode[static_cast<uint32_t>(value) >> 18]); }
+  static inline float ToFloat(const char* in) { return ulawDecode[static_cast<uint8_t>(*in)] / 32768.0f; }
+  static inline void FromFloat(float value, char* out) { *out = static_cast<char>(ulawEncode[static_cast<uint16_t>(FloatToS16(value)) >> 2]); }
+};
+
+struct ALawCodec {
+  static const int size = 1;
+  static const bool isFloat = false;
+  static const bool wide = false;
+  static inline int32_t ToInt(const char* in) { return static_cast<int32_t>(static_cast<uint32_t>(static_cast<uint16_t>(alawDecode[static_cast<uint8_t>(*in)])) << 16); }
+  static inline void FromInt(int32_t value, char* out) { *out = static_cast<char>(alawEncode[static_cast<uint32_t>(value) >> 19]); }
+  static inline float ToFloat(const char* in) { return alawDecode[static_cast<uint8_t>(*in)] / 32768.0f; }
+  static inline void FromFloat(float value, char* out) { *out = static_cast<char>(alawEncode[static_cast<uint16_t>(FloatToS16(value)) >> 3]); }
+};
+
+typedef F32Codec<false> F32LE;
+typedef F32Codec<true> F32BE;
+typedef S16Codec<false> S16LE;
+typedef S16Codec<true> S16BE;
+typedef U16Codec<false> U16LE;
+typedef U16Codec<true> U16BE;
+typedef S24Codec<false> S24LE;
+typedef S24Codec<true> S24BE;
+typedef S32Codec<false> S32LE;
+typedef S32Codec<true> S32BE;
+typedef F64Codec<false> F64LE;
+typedef F64Codec<true> F64BE;
+typedef U8Codec U8;
+typedef ULawCodec ULAW;
+typedef ALawCodec ALAW;
+
+// Picks the signed or unsigned 16-bit codec, for kernels templated on both.
+template <bool U, bool BE>
+struct Pcm16 {
+  typedef S16Codec<BE> Codec;
+};
+
+template <bool BE>
+struct Pcm16<true, BE> {
+  typedef U16Codec<BE> Codec;
+};
+
+// Every supported format, with its codec. Adding a format means adding a
+// codec above and a line here, conversions are generated from this list.
+#define PCM_FORMATS(X)                                                         \
+  X(FMT_F32LE, F32LE)                                                          \
+  X(FMT_F32BE, F32BE)                                                          \
+  X(FMT_S16LE, S16LE)                                                          \
+  X(FMT_S16BE, S16BE)                                                          \
+  X(FMT_U16LE, U16LE)                                                          \
+  X(FMT_U16BE, U16BE)                                                          \
+  X(FMT_S24LE, S24LE)                                                          \
+  X(FMT_S24BE, S24BE)                                                          \
+  X(FMT_S32LE, S32LE)                                                          \
+  X(FMT_S32BE, S32BE)                                                          \
+  X(FMT_F64LE, F64LE)                                                          \
+  X(FMT_F64BE, F64BE)                                                          \
+  X(FMT_U8, U8)                                                                \
+  X(FMT_ULAW, ULAW)                                                            \
+  X(FMT_ALAW, ALAW)
+
+}
+
+#endif
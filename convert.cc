@@ -0,0 +1,336 @@
+#include <uv.h>
+#include "convert.h"
+#include "simd.h"
+
+using namespace pcmutils;
+
+static ConvertKernel kernels[FMT_COUNT][FMT_COUNT];
+
+enum { DOMAIN_INT, DOMAIN_FLOAT, DOMAIN_DOUBLE };
+
+// Integer pairs stay integer. Float goes through double only when both
+// sides have the precision to need it.
+template <class In, class Out, int Domain = !(In::isFloat || Out::isFloat) ? DOMAIN_INT
+    : (In::wide && Out::wide ? DOMAIN_DOUBLE : DOMAIN_FLOAT)>
+struct Transcode {
+  static inline void Run(const char* in, char* out) { Out::FromFloat(In::ToFloat(in), out); }
+};
+
+template <class In, class Out>
+struct Transcode<In, Out, DOMAIN_INT> {
+  static inline void Run(const char* in, char* out) { Out::FromInt(In::ToInt(in), out); }
+};
+
+template <class In, class Out>
+struct Transcode<In, Out, DOMAIN_DOUBLE> {
+  static inline void Run(const char* in, char* out) { Out::FromDouble(In::ToDouble(in), out); }
+};
+
+// Generic kernels, also used for the tails of the vectorized ones.
+template <class In, class Out>
+static void Convert(const char* in, char* out, size_t samples) {
+  for (size_t i = 0; i < samples; i++) {
+    Transcode<In, Out>::Run(in + i * In::size, out + i * Out::size);
+  }
+}
+
+template <class In>
+static ConvertKernel SelectOutput(int outFormat) {
+#define CONVERT_OUTPUT_CASE(format, codec)                                     \
+  case format: return Convert<In, codec>;
+
+  switch (outFormat) {
+    PCM_FORMATS(CONVERT_OUTPUT_CASE)
+  }
+  return NULL;
+
+#undef CONVERT_OUTPUT_CASE
+}
+
+static ConvertKernel SelectGeneric(int inFormat, int outFormat) {
+#define CONVERT_INPUT_CASE(format, codec)                                      \
+  case format: return SelectOutput<codec>(outFormat);
+
+  switch (inFormat) {
+    PCM_FORMATS(CONVERT_INPUT_CASE)
+  }
+  return NULL;
+
+#undef CONVERT_INPUT_CASE
+}
+
+int pcmutils::FormatAlignment(int format) {
+#define CONVERT_ALIGNMENT_CASE(format, codec)                                  \
+  case format: return codec::size;
+
+  switch (format) {
+    PCM_FORMATS(CONVERT_ALIGNMENT_CASE)
+  }
+  return 0;
+
+#undef CONVERT_ALIGNMENT_CASE
+}
+
+
+// Helpers for wiring the vectorized kernels into the table.
+
+static inline int F32Format(bool be) {
+  return be ? FMT_F32BE : FMT_F32LE;
+}
+
+static inline int Pcm16Format(bool u, bool be) {
+  return u ? (be ? FMT_U16BE : FMT_U16LE) : (be ? FMT_S16BE : FMT_S16LE);
+}
+
+static inline int S24Format(bool be) {
+  return be ? FMT_S24BE : FMT_S24LE;
+}
+
+#ifdef PCM_X86
+
+// SSE2 kernels, 8 samples per iteration. Byte swapping for big-endian
+// formats and sign flipping for unsigned ones are folded into the same
+// pass, and compile away when not needed.
+
+PCM_TARGET("sse2")
+static inline __m128i Sse2FloatToS16(__m128 a, __m128 b) {
+  const __m128 scale = _mm_set1_ps(32767.0f);
+  const __m128 lo = _mm_set1_ps(-32768.0f);
+  a = _mm_min_ps(_mm_max_ps(_mm_mul_ps(a, scale), lo), scale);
+  b = _mm_min_ps(_mm_max_ps(_mm_mul_ps(b, scale), lo), scale);
+  return _mm_packs_epi32(_mm_cvttps_epi32(a), _mm_cvttps_epi32(b));
+}
+
+template <bool InBE, bool OutBE, bool OutU>
+PCM_TARGET("sse2")
+static void Sse2FloatToPcm16(const char* in, char* out, size_t samples) {
+  const __m128i flip = _mm_set1_epi16(OutU ? (short)0x8000 : 0);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i value = Sse2FloatToS16(Sse2LoadFloat<InBE>(in + i * 4), Sse2LoadFloat<InBE>(in + i * 4 + 16));
+    _mm_storeu_si128((__m128i*)(out + i * 2), Sse2Swap16<OutBE>(_mm_xor_si128(value, flip)));
+  }
+  Convert<F32Codec<InBE>, typename Pcm16<OutU, OutBE>::Codec>(in + i * 4, out + i * 2, samples - i);
+}
+
+template <bool InBE, bool InU, bool OutBE>
+PCM_TARGET("sse2")
+static void Sse2Pcm16ToFloat(const char* in, char* out, size_t samples) {
+  const __m128i flip = _mm_set1_epi16(InU ? (short)0x8000 : 0);
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i value = _mm_xor_si128(Sse2Swap16<InBE>(_mm_loadu_si128((const __m128i*)(in + i * 2))), flip);
+    __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16);
+    __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16);
+    Sse2StoreFloat<OutBE>(out + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    Sse2StoreFloat<OutBE>(out + i * 4 + 16, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  Convert<typename Pcm16<InU, InBE>::Codec, F32Codec<OutBE> >(in + i * 2, out + i * 4, samples - i);
+}
+
+template <bool InBE, bool InU, bool OutBE, bool OutU>
+PCM_TARGET("sse2")
+static void Sse2Pcm16ToPcm16(const char* in, char* out, size_t samples) {
+  // Flip the sign bit where it sits in the input byte order, then swap.
+  const __m128i flip = _mm_set1_epi16(InU == OutU ? 0 : (InBE ? 0x0080 : (short)0x8000));
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m128i value = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + i * 2)), flip);
+    _mm_storeu_si128((__m128i*)(out + i * 2), Sse2Swap16<InBE != OutBE>(value));
+  }
+  Convert<typename Pcm16<InU, InBE>::Codec, typename Pcm16<OutU, OutBE>::Codec>(in + i * 2, out + i * 2, samples - i);
+}
+
+template <bool InBE, bool OutBE>
+PCM_TARGET("sse2")
+static void Sse2FloatToFloat(const char* in, char* out, size_t samples) {
+  size_t i = 0;
+  for (; i + 4 <= samples; i += 4) {
+    __m128i value = _mm_loadu_si128((const __m128i*)(in + i * 4));
+    _mm_storeu_si128((__m128i*)(out + i * 4), Sse2Swap32<InBE != OutBE>(value));
+  }
+  Convert<F32Codec<InBE>, F32Codec<OutBE> >(in + i * 4, out + i * 4, samples - i);
+}
+
+// AVX2 kernels, 16 samples per iteration.
+
+PCM_TARGET("avx2")
+static inline __m256i Avx2FloatToS16(__m256 a, __m256 b) {
+  const __m256 scale = _mm256_set1_ps(32767.0f);
+  const __m256 lo = _mm256_set1_ps(-32768.0f);
+  a = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(a, scale), lo), scale);
+  b = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(b, scale), lo), scale);
+  // packs works per 128-bit lane, put the quadwords back in order.
+  __m256i packed = _mm256_packs_epi32(_mm256_cvttps_epi32(a), _mm256_cvttps_epi32(b));
+  return _mm256_permute4x64_epi64(packed, 0xD8);
+}
+
+template <bool InBE, bool OutBE, bool OutU>
+PCM_TARGET("avx2")
+static void Avx2FloatToPcm16(const char* in, char* out, size_t samples) {
+  const __m256i flip = _mm256_set1_epi16(OutU ? (short)0x8000 : 0);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i value = Avx2FloatToS16(Avx2LoadFloat<InBE>(in + i * 4), Avx2LoadFloat<InBE>(in + i * 4 + 32));
+    _mm256_storeu_si256((__m256i*)(out + i * 2), Avx2Swap16<OutBE>(_mm256_xor_si256(value, flip)));
+  }
+  Sse2FloatToPcm16<InBE, OutBE, OutU>(in + i * 4, out + i * 2, samples - i);
+}
+
+template <bool InBE, bool InU, bool OutBE>
+PCM_TARGET("avx2")
+static void Avx2Pcm16ToFloat(const char* in, char* out, size_t samples) {
+  const __m256i flip = _mm256_set1_epi16(InU ? (short)0x8000 : 0);
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i value = _mm256_xor_si256(Avx2Swap16<InBE>(_mm256_loadu_si256((const __m256i*)(in + i * 2))), flip);
+    __m256i lo = _mm256_cvtepi16_epi32(_mm256_castsi256_si128(value));
+    __m256i hi = _mm256_cvtepi16_epi32(_mm256_extracti128_si256(value, 1));
+    Avx2StoreFloat<OutBE>(out + i * 4, _mm256_mul_ps(_mm256_cvtepi32_ps(lo), scale));
+    Avx2StoreFloat<OutBE>(out + i * 4 + 32, _mm256_mul_ps(_mm256_cvtepi32_ps(hi), scale));
+  }
+  Sse2Pcm16ToFloat<InBE, InU, OutBE>(in + i * 2, out + i * 4, samples - i);
+}
+
+template <bool InBE, bool InU, bool OutBE, bool OutU>
+PCM_TARGET("avx2")
+static void Avx2Pcm16ToPcm16(const char* in, char* out, size_t samples) {
+  const __m256i flip = _mm256_set1_epi16(InU == OutU ? 0 : (InBE ? 0x0080 : (short)0x8000));
+  size_t i = 0;
+  for (; i + 16 <= samples; i += 16) {
+    __m256i value = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + i * 2)), flip);
+    _mm256_storeu_si256((__m256i*)(out + i * 2), Avx2Swap16<InBE != OutBE>(value));
+  }
+  Sse2Pcm16ToPcm16<InBE, InU, OutBE, OutU>(in + i * 2, out + i * 2, samples - i);
+}
+
+template <bool InBE, bool OutBE>
+PCM_TARGET("avx2")
+static void Avx2FloatToFloat(const char* in, char* out, size_t samples) {
+  size_t i = 0;
+  for (; i + 8 <= samples; i += 8) {
+    __m256i value = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+    _mm256_storeu_si256((__m256i*)(out + i * 4), Avx2Swap32<InBE != OutBE>(value));
+  }
+  Sse2FloatToFloat<InBE, OutBE>(in + i * 4, out + i * 4, samples - i);
+}
+
+// SSSE3 packed 24-bit kernels, 8 samples per iteration. A shuffle moves
+// each 3-byte sample to the top of a 32-bit lane (or back), in whichever
+// byte order the format uses. Loads and stores cover 16 bytes for 12 bytes
+// of samples, so the loops stop early enough to stay inside the buffers.
+
+template <bool BE>
+PCM_TARGET("ssse3")
+static inline __m128i Ssse3UnpackS24(const char* in) {
+  const __m128i mask = BE
+    ? _mm_setr_epi8(-1, 2, 1, 0, -1, 5, 4, 3, -1, 8, 7, 6, -1, 11, 10, 9)
+    : _mm_setr_epi8(-1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11);
+  return _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)in), mask);
+}
+
+template <bool BE>
+PCM_TARGET("ssse3")
+static inline __m128i Ssse3PackS24(__m128i value) {
+  const __m128i mask = BE
+    ? _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1)
+    : _mm_setr_epi8(0, 1, 2, 4, 5, 6, 8, 9, 10, 12, 13, 14, -1, -1, -1, -1);
+  return _mm_shuffle_epi8(value, mask);
+}
+
+template <bool InBE, bool OutBE>
+PCM_TARGET("ssse3")
+static void Ssse3S24ToFloat(const char* in, char* out, size_t samples) {
+  const __m128 scale = _mm_set1_ps(1.0f / 2147483648.0f);
+  size_t i = 0;
+  for (; i + 10 <= samples; i += 8) {
+    __m128i lo = Ssse3UnpackS24<InBE>(in + i * 3);
+    __m128i hi = Ssse3UnpackS24<InBE>(in + i * 3 + 12);
+    Sse2StoreFloat<OutBE>(out + i * 4, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    Sse2StoreFloat<OutBE>(out + i * 4 + 16, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  Convert<S24Codec<InBE>, F32Codec<OutBE> >(in + i * 3, out + i * 4, samples - i);
+}
+
+template <bool InBE, bool OutBE>
+PCM_TARGET("ssse3")
+static void Ssse3FloatToS24(const char* in, char* out, size_t samples) {
+  const __m128 scale = _mm_set1_ps(8388607.0f);
+  const __m128 minimum = _mm_set1_ps(-8388608.0f);
+  size_t i = 0;
+  for (; i + 10 <= samples; i += 8) {
+    __m128 lo = _mm_min_ps(_mm_max_ps(_mm_mul_ps(Sse2LoadFloat<InBE>(in + i * 4), scale), minimum), scale);
+    __m128 hi = _mm_min_ps(_mm_max_ps(_mm_mul_ps(Sse2LoadFloat<InBE>(in + i * 4 + 16), scale), minimum), scale);
+    _mm_storeu_si128((__m128i*)(out + i * 3), Ssse3PackS24<OutBE>(_mm_cvttps_epi32(lo)));
+    _mm_storeu_si128((__m128i*)(out + i * 3 + 12), Ssse3PackS24<OutBE>(_mm_cvttps_epi32(hi)));
+  }
+  Convert<F32Codec<InBE>, S24Codec<OutBE> >(in + i * 4, out + i * 3, samples - i);
+}
+
+// Registers the vectorized kernels for one input/output byte order pair.
+// Same-format pairs are left to the generic copy loop.
+#define REGISTER_SIMD_KERNELS(isa, InBE, OutBE)                                \
+  kernels[F32Format(InBE)][Pcm16Format(false, OutBE)] = isa##FloatToPcm16<InBE, OutBE, false>; \
+  kernels[F32Format(InBE)][Pcm16Format(true, OutBE)] = isa##FloatToPcm16<InBE, OutBE, true>; \
+  kernels[Pcm16Format(false, InBE)][F32Format(OutBE)] = isa##Pcm16ToFloat<InBE, false, OutBE>; \
+  kernels[Pcm16Format(true, InBE)][F32Format(OutBE)] = isa##Pcm16ToFloat<InBE, true, OutBE>; \
+  kernels[Pcm16Format(false, InBE)][Pcm16Format(true, OutBE)] = isa##Pcm16ToPcm16<InBE, false, OutBE, true>; \
+  kernels[Pcm16Format(true, InBE)][Pcm16Format(false, OutBE)] = isa##Pcm16ToPcm16<InBE, true, OutBE, false>; \
+  if (InBE != OutBE) {                                                         \
+    kernels[Pcm16Format(false, InBE)][Pcm16Format(false, OutBE)] = isa##Pcm16ToPcm16<InBE, false, OutBE, false>; \
+    kernels[Pcm16Format(true, InBE)][Pcm16Format(true, OutBE)] = isa##Pcm16ToPcm16<InBE, true, OutBE, true>; \
+    kernels[F32Format(InBE)][F32Format(OutBE)] = isa##FloatToFloat<InBE, OutBE>; \
+  }
+
+#define REGISTER_S24_KERNELS(isa, InBE, OutBE)                                 \
+  kernels[S24Format(InBE)][F32Format(OutBE)] = isa##S24ToFloat<InBE, OutBE>;   \
+  kernels[F32Format(InBE)][S24Format(OutBE)] = isa##FloatToS24<InBE, OutBE>;
+
+#endif
+
+static void BuildConvertKernels() {
+  for (int in = 0; in < FMT_COUNT; in++) {
+    for (int out = 0; out < FMT_COUNT; out++) {
+      kernels[in][out] = SelectGeneric(in, out);
+    }
+  }
+
+#ifdef PCM_X86
+  const CpuFeatures& cpu = GetCpuFeatures();
+
+  if (cpu.sse2) {
+    REGISTER_SIMD_KERNELS(Sse2, false, false)
+    REGISTER_SIMD_KERNELS(Sse2, false, true)
+    REGISTER_SIMD_KERNELS(Sse2, true, false)
+    REGISTER_SIMD_KERNELS(Sse2, true, true)
+  }
+
+  if (cpu.ssse3) {
+    REGISTER_S24_KERNELS(Ssse3, false, false)
+    REGISTER_S24_KERNELS(Ssse3, false, true)
+    REGISTER_S24_KERNELS(Ssse3, true, false)
+    REGISTER_S24_KERNELS(Ssse3, true, true)
+  }
+
+  if (cpu.avx2) {
+    REGISTER_SIMD_KERNELS(Avx2, false, false)
+    REGISTER_SIMD_KERNELS(Avx2, false, true)
+    REGISTER_SIMD_KERNELS(Avx2, true, false)
+    REGISTER_SIMD_KERNELS(Avx2, true, true)
+  }
+#endif
+}
+
+// The G.711 kernels read the codec tables, so those are built first.
+void pcmutils::InitConvertKernels() {
+  static uv_once_t once = UV_ONCE_INIT;
+  InitCodecTables();
+  uv_once(&once, BuildConvertKernels);
+}
+
+ConvertKernel pcmutils::GetConvertKernel(int inFormat, int outFormat) {
+  if (inFormat < 0 || inFormat >= FMT_COUNT || outFormat < 0 || outFormat >= FMT_COUNT) return NULL;
+  return kernels[inFormat][outFormat];
+}
\ No newline at end of file
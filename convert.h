@@ -0,0 +1,24 @@
+#ifndef CONVERT_H
+#define CONVERT_H
+
+#include <cstddef>
+#include "codecs.h"
+
+namespace pcmutils {
+
+// Converts `samples` samples from `in` to `out`. Neither pointer needs to
+// be aligned, and they must not overlap.
+typedef void (*ConvertKernel)(const char* in, char* out, size_t samples);
+
+// Picks the fastest kernel for each format pair the CPU can run.
+void InitConvertKernels();
+
+// Returns NULL for unsupported pairs.
+ConvertKernel GetConvertKernel(int inFormat, int outFormat);
+
+// Bytes per sample, or 0 for unsupported formats.
+int FormatAlignment(int format);
+
+}
+
+#endif
@@ -0,0 +1,38 @@
+#include "cpu.h"
+
+#ifdef PCM_X86
+#include <cpuid.h>
+#endif
+
+using namespace pcmutils;
+
+static CpuFeatures DetectCpuFeatures() {
+  CpuFeatures features = { false, false, false, false };
+
+#ifdef PCM_X86
+  unsigned int eax, ebx, ecx, edx;
+  if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return features;
+
+  features.sse2 = (edx & bit_SSE2) != 0;
+  features.ssse3 = (ecx & bit_SSSE3) != 0;
+  features.sse41 = (ecx & bit_SSE4_1) != 0;
+
+  // AVX state must also be enabled by the OS before we can touch ymm.
+  bool osxsave = (ecx & bit_OSXSAVE) != 0;
+  if (osxsave && __get_cpuid_max(0, 0) >= 7) {
+    unsigned int xcr0lo, xcr0hi;
+    __asm__ ("xgetbv" : "=a" (xcr0lo), "=d" (xcr0hi) : "c" (0));
+    if ((xcr0lo & 6) == 6) {
+      __cpuid_count(7, 0, eax, ebx, ecx, edx);
+      features.avx2 = (ebx & bit_AVX2) != 0;
+    }
+  }
+#endif
+
+  return features;
+}
+
+const CpuFeatures& pcmutils::GetCpuFeatures() {
+  static CpuFeatures features = DetectCpuFeatures();
+  return features;
+}
\ No newline at end of file
@@ -0,0 +1,23 @@
+#ifndef CPU_H
+#define CPU_H
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define PCM_X86 1
+#define PCM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace pcmutils {
+
+struct CpuFeatures {
+  bool sse2;
+  bool ssse3;
+  bool sse41;
+  bool avx2;
+};
+
+// Detected once via CPUID, the first time it's asked for.
+const CpuFeatures& GetCpuFeatures();
+
+}
+
+#endif
@@ -0,0 +1,37 @@
+#include "fifo.h"
+
+using namespace pcmutils;
+
+Fifo::Fifo(size_t capacity_) : capacity(capacity_), data(NULL), writePos(0), readPos(0), releasePos(0) {
+  data = (char*)malloc(capacity);
+}
+
+Fifo::~Fifo() {
+  free(data);
+  data = NULL;
+  capacity = 0;
+}
+
+size_t Fifo::Write(const char* in, size_t length) {
+  size_t space = capacity - (writePos - releasePos);
+  if (length > space) length = space;
+
+  // At most two copies, either side of the wrap.
+  size_t first = Contiguous(writePos);
+  if (first > length) first = length;
+  memcpy(data + writePos % capacity, in, first);
+  memcpy(data, in + first, length - first);
+
+  writePos += length;
+  return length;
+}
+
+size_t Fifo::Read(size_t length) {
+  size_t start = readPos;
+  readPos += length;
+  return start;
+}
+
+void Fifo::Release(size_t length) {
+  releasePos += length;
+}
@@ -0,0 +1,43 @@
+#ifndef FIFO_H
+#define FIFO_H
+
+#include <cstdlib>
+#include <cstring>
+
+namespace pcmutils {
+
+// Byte ring buffering one input of a Mixer or Zipper. Writes of any size
+// are copied in on the loop thread. Blocks are then read in place: Read()
+// hands out the next range, and the range stays off limits to writers
+// until Release(), once its block is done. Workers only ever call At() and
+// Contiguous(), on ranges handed to them.
+//
+// Positions count bytes since the start of the stream. The capacity is a
+// whole number of samples, so samples never straddle the wrap.
+class Fifo {
+public:
+  Fifo(size_t capacity_);
+  ~Fifo();
+
+  // Copies in as much as fits, and returns how much that was.
+  size_t Write(const char* data, size_t length);
+
+  size_t Readable() const { return writePos - readPos; }
+  size_t Read(size_t length);
+  void Release(size_t length);
+
+  const char* At(size_t pos) const { return data + pos % capacity; }
+  size_t Contiguous(size_t pos) const { return capacity - pos % capacity; }
+
+  size_t capacity;
+
+protected:
+  char* data;
+  size_t writePos;
+  size_t readPos;
+  size_t releasePos;
+};
+
+}
+
+#endif
@@ -8,7 +8,16 @@ void Formatter::Init(Handle<Object> exports) {
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
   tpl->SetClassName(String::NewFromUtf8(isolate, "Formatter"));
 
+  InitConvertKernels();
+
   NODE_SET_PROTOTYPE_METHOD(tpl, "format", Format);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "formatSync", FormatSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", Release);
+
+  NODE_SET_GETTER(isolate, tpl, "pool", PoolGetter);
+  NODE_SET_GETTER(isolate, tpl, "samplesPerBuffer", SamplesPerBufferGetter);
+  NODE_SET_GETTER(isolate, tpl, "saturated", SaturatedGetter);
+  NODE_SET_GETTER(isolate, tpl, "syncThreshold", SyncThresholdGetter);
 
   // Persistent<Function> constructor = Persistent<Function>::New(isolate, tpl->GetFunction());
   exports->Set(String::NewFromUtf8(isolate, "Formatter"), tpl->GetFunction());
@@ -23,27 +32,63 @@ void Formatter::New(const FunctionCallbackInfo<Value>& args) {
   }
 
   REQUIRE_ARGUMENTS(isolate, 2);
+  OPTIONAL_ARGUMENT_OBJECT(isolate, 2, options);
+
+  int blockSamples = OPTION_INT(isolate, options, "blockSize", FMT_BUFFER_SAMPLES);
+  if (blockSamples < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid block size")));
+    return;
+  }
+
+  // Resolve the conversion once, so bad pairs fail here and not per batch.
+  ConvertKernel kernel = GetConvertKernel(args[0]->Int32Value(), args[1]->Int32Value());
+  if (kernel == NULL) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Unsupported conversion")));
+    return;
+  }
 
   Formatter* fmt = new Formatter();
   fmt->Wrap(args.This());
+  AddQueueOwner(fmt, CancelQueued);
+  fmt->isolate = isolate;
+  fmt->loop = GetCurrentEventLoop(isolate);
 
   fmt->inFormat = args[0]->Int32Value();
   fmt->outFormat = args[1]->Int32Value();
+  fmt->inAlignment = FormatAlignment(fmt->inFormat);
+  fmt->outAlignment = FormatAlignment(fmt->outFormat);
+  fmt->kernel = kernel;
+  fmt->blockSamples = blockSamples;
+  fmt->wholeChunk = OPTION_BOOL(isolate, options, "wholeChunk", false);
+  fmt->typedFormat = OPTION_BOOL(isolate, options, "typed", false) ? fmt->outFormat : -1;
+  if (fmt->typedFormat >= 0 && !HasTypedView(fmt->typedFormat)) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "No typed array for this format")));
+    return;
+  }
   fmt->formatting = false;
+  fmt->queueSize = OPTION_INT(isolate, options, "queueSize", FMT_QUEUE_SIZE);
+  if (fmt->queueSize < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid queue size")));
+    return;
+  }
+  fmt->parallel = OPTION_INT(isolate, options, "parallel", 1);
+  if (fmt->parallel < 1) fmt->parallel = 1;
+  fmt->syncThreshold = OPTION_INT(isolate, options, "syncThreshold", FMT_SYNC_SAMPLES);
 
-  // TODO: lol
-  if (fmt->inFormat == 0) fmt->inAlignment = 4;
-  if (fmt->inFormat == 2) fmt->inAlignment = 2;
-  if (fmt->inFormat == 4) fmt->inAlignment = 2;
-  if (fmt->outFormat == 0) fmt->outAlignment = 4;
-  if (fmt->outFormat == 2) fmt->outAlignment = 2;
-  if (fmt->outFormat == 4) fmt->outAlignment = 2;
-
-  fmt->buffer = (char*)malloc(fmt->outAlignment * FMT_BUFFER_SAMPLES);
+  fmt->carry = new CarryBuffer(fmt->inAlignment);
+  fmt->pool = new BufferPool(OPTION_INT(isolate, options, "slabSize", fmt->blockSamples * fmt->outAlignment));
 
   args.GetReturnValue().Set(args.This());
 }
 
+void Formatter::CancelQueued(void* arg) {
+  Formatter* fmt = static_cast<Formatter*>(arg);
+  while (!fmt->queue.empty()) {
+    delete fmt->queue.front();
+    fmt->queue.pop_front();
+  }
+}
+
 void Formatter::Format(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
 
@@ -52,128 +97,198 @@ void Formatter::Format(const FunctionCallbackInfo<Value>& args) {
 
   Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.Holder());
 
-  COND_ERR_CALL(isolate, fmt->formatting, callback, "Still formatting");
+  COND_ERR_CALL(isolate, fmt->queue.size() >= static_cast<size_t>(fmt->queueSize), callback, "Queue full");
 
   FormatBaton* baton = new FormatBaton(isolate, fmt, callback, args[0]->ToObject());
-  fmt->formatting = true;
-  BeginFormat(baton);
-}
+  if (fmt->formatting) {
+    fmt->queue.push_back(baton);
+  } else {
+    fmt->formatting = true;
+    BeginFormat(baton);
+  }
 
-void Formatter::BeginFormat(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoFormat, (uv_after_work_cb)AfterFormat);
+  // Like a stream write, false asks the caller to wait for a chunk to finish.
+  args.GetReturnValue().Set(Boolean::New(isolate, fmt->queue.size() < static_cast<size_t>(fmt->queueSize)));
 }
 
-void Formatter::DoFormat(uv_work_t* req) {
-  FormatBaton* baton = static_cast<FormatBaton*>(req->data);
-  Formatter* fmt = baton->fmt;
+// Converts a whole chunk right here on the JS thread, for chunks too small
+// to be worth a worker. Earlier chunks must be done, so output stays in order.
+void Formatter::FormatSync(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
 
-  int chunkSamples = baton->chunkLength / fmt->inAlignment;
-  int limitSamples;
-  int chunkSamplesLeft = chunkSamples - baton->totalSamples;
-  if (FMT_BUFFER_SAMPLES < chunkSamplesLeft) {
-    limitSamples = FMT_BUFFER_SAMPLES;
-  } else {
-    limitSamples = chunkSamplesLeft;
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.Holder());
+
+  if (!Buffer::HasInstance(args[0])) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid buffer")));
+    return;
   }
 
-  if (fmt->inFormat == 0) { // F32LE
+  if (fmt->formatting) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Format in progress")));
+    return;
+  }
 
-    if (fmt->outFormat == 2) {            // F32LE to S16LE
+  // The same baton a worker gets, so split samples are stitched the same way.
+  FormatBaton* baton = new FormatBaton(isolate, fmt, Local<Function>(), args[0]->ToObject());
+  baton->formattedSamples = baton->chunkSamples;
+  baton->buffer = fmt->pool->Acquire(baton->formattedSamples * fmt->outAlignment);
+  FormatRange(baton, 0, baton->formattedSamples, baton->buffer);
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        float* floatChunk = static_cast<float*>(static_cast<void*>(baton->chunkData));
-        float floatVal = floatChunk[baton->totalSamples + sample];
-        int16_t* intBuffer = static_cast<int16_t*>(static_cast<void*>(fmt->buffer));
-        intBuffer[sample] = static_cast<int16_t>(floatVal * 32767);
-      }
+  Local<Object> buffer = fmt->pool->Wrap(isolate, baton->buffer, baton->formattedSamples * fmt->outAlignment, fmt->typedFormat);
+  baton->buffer = NULL;
+  delete baton;
 
-    } else if (fmt->outFormat == 4) {     // F32LE to U16LE
+  args.GetReturnValue().Set(buffer);
+}
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        float* floatChunk = static_cast<float*>(static_cast<void*>(baton->chunkData));
-        float floatVal = floatChunk[baton->totalSamples + sample];
-        uint16_t* uintBuffer = static_cast<uint16_t*>(static_cast<void*>(fmt->buffer));
-        uintBuffer[sample] = static_cast<uint16_t>((floatVal * 32767) + 32768);
-      }
+void Formatter::Release(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
 
-    } else {
-      fprintf(stderr, "Unsupported conversion\n");
-    }
+  REQUIRE_ARGUMENTS(isolate, 1);
 
-  } else if (fmt->inFormat == 2) { // S16LE
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.Holder());
+  bool released = fmt->pool->Release(isolate, args[0]);
+  args.GetReturnValue().Set(Boolean::New(isolate, released));
+}
 
-    if (fmt->outFormat == 0) {            // S16LE to F32LE
+void Formatter::PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.This());
+  args.GetReturnValue().Set(fmt->pool->Stats(isolate));
+}
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        int16_t* intChunk = static_cast<int16_t*>(static_cast<void*>(baton->chunkData));
-        int16_t intVal = intChunk[baton->totalSamples + sample];
-        float* floatBuffer = static_cast<float*>(static_cast<void*>(fmt->buffer));
-        floatBuffer[sample] = static_cast<float>(intVal / 32768);
-      }
+void Formatter::SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, fmt->blockSamples));
+}
 
-    } else if (fmt->outFormat == 4) {     // S16LE to U16LE
+void Formatter::SyncThresholdGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, fmt->syncThreshold));
+}
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        int16_t* intChunk = static_cast<int16_t*>(static_cast<void*>(baton->chunkData));
-        int16_t intVal = intChunk[baton->totalSamples + sample];
-        uint16_t* uintBuffer = static_cast<uint16_t*>(static_cast<void*>(fmt->buffer));
-        uintBuffer[sample] = static_cast<uint16_t>(intVal + 32768);
-      }
+void Formatter::SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Formatter* fmt = ObjectWrap::Unwrap<Formatter>(args.This());
+  args.GetReturnValue().Set(Boolean::New(isolate, fmt->queue.size() >= static_cast<size_t>(fmt->queueSize)));
+}
 
-    } else {
-      fprintf(stderr, "Unsupported conversion\n");
-    }
+void Formatter::BeginFormat(Baton* baton) {
+  FormatBaton* fmtBaton = static_cast<FormatBaton*>(baton);
+  Formatter* fmt = baton->fmt;
 
-  } else if (fmt->inFormat == 4) { // U16LE
+  // A chunk that only topped up a split sample has nothing to do, and is
+  // done right here without a worker or any output.
+  if (fmtBaton->chunkSamples == 0) {
+    HandleScope scope(fmt->isolate);
+    FinishFormat(fmtBaton, Null(fmt->isolate));
+    return;
+  }
 
-    if (fmt->outFormat == 0) {            // U16LE to F32LE
+  int chunkSamplesLeft = fmtBaton->chunkSamples - fmtBaton->totalSamples;
+  if (fmtBaton->blockSamples < chunkSamplesLeft) {
+    fmtBaton->formattedSamples = fmtBaton->blockSamples;
+  } else {
+    fmtBaton->formattedSamples = chunkSamplesLeft;
+  }
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        uint16_t* intChunk = static_cast<uint16_t*>(static_cast<void*>(baton->chunkData));
-        uint16_t intVal = intChunk[baton->totalSamples + sample];
-        float* floatBuffer = static_cast<float*>(static_cast<void*>(fmt->buffer));
-        floatBuffer[sample] = static_cast<float>((intVal - 32768) / 32768);
-      }
+  fmtBaton->buffer = fmt->pool->Acquire(fmtBaton->formattedSamples * fmt->outAlignment);
 
-    } else if (fmt->outFormat == 2) {     // U16LE to S16LE
+  // Large blocks are split by sample range over up to `parallel` workers.
+  if (!fmtBaton->shards.Queue(fmt->loop, fmtBaton, fmtBaton->formattedSamples, DoFormatShard, AfterFormatShard)) {
+    QueueWork(fmt->loop, &baton->request, DoFormat, AfterFormat);
+  }
+}
 
-      for (int sample = 0; sample < limitSamples; sample++) {
-        uint16_t* intChunk = static_cast<uint16_t*>(static_cast<void*>(baton->chunkData));
-        uint16_t intVal = intChunk[baton->totalSamples + sample];
-        int16_t* intBuffer = static_cast<int16_t*>(static_cast<void*>(fmt->buffer));
-        intBuffer[sample] = static_cast<int16_t>(intVal - 32768);
-      }
+void Formatter::DoFormat(uv_work_t* req) {
+  FormatBaton* baton = static_cast<FormatBaton*>(req->data);
+  FormatRange(baton, baton->totalSamples, baton->formattedSamples, baton->buffer);
+}
 
-    } else {
-      fprintf(stderr, "Unsupported conversion\n");
-    }
+void Formatter::FormatRange(FormatBaton* baton, int start, int samples, char* out) {
+  Formatter* fmt = baton->fmt;
 
-  } else {
-    fprintf(stderr, "Unsupported conversion\n");
+  // The stitched sample, if any, comes before the rest of the chunk.
+  if (start < baton->headSamples && samples > 0) {
+    fmt->kernel(baton->head, out, 1);
+    out += fmt->outAlignment;
+    start++;
+    samples--;
   }
 
-  baton->totalSamples += limitSamples;
-  baton->formattedSamples = limitSamples;
+  fmt->kernel(baton->chunkData + (start - baton->headSamples) * fmt->inAlignment, out, samples);
 }
 
-void Formatter::AfterFormat(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
+void Formatter::DoFormatShard(uv_work_t* req) {
+  Shard* shard = static_cast<Shard*>(req->data);
+  FormatBaton* baton = static_cast<FormatBaton*>(shard->baton);
+  Formatter* fmt = baton->fmt;
+
+  FormatRange(baton, baton->totalSamples + shard->offset, shard->length, baton->buffer + shard->offset * fmt->outAlignment);
+}
+
+void Formatter::AfterFormatShard(uv_work_t* req, int status) {
+  Shard* shard = static_cast<Shard*>(req->data);
+  FormatBaton* baton = static_cast<FormatBaton*>(shard->baton);
+
+  if (!baton->shards.Join()) return;
+  AfterFormat(&baton->request, status);
+}
+
+void Formatter::AfterFormat(uv_work_t* req, int status) {
   FormatBaton* baton = static_cast<FormatBaton*>(req->data);
+
+  if (status == UV_ECANCELED) {
+    delete baton;
+    return;
+  }
+
   Formatter* fmt = baton->fmt;
+  Isolate *isolate = fmt->isolate;
+  HandleScope scope(isolate);
 
-  // Copy buffer because we may clobber them soon.
-  MaybeLocal<Object> buffer = Buffer::New(isolate, fmt->buffer, baton->formattedSamples * fmt->outAlignment);
+  baton->totalSamples += baton->formattedSamples;
 
-  if (baton->chunkLength / fmt->inAlignment > static_cast<size_t>(baton->totalSamples)) {
-    Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer.ToLocalChecked()), Local<Value>::New(isolate, Boolean::New(isolate, false)) };
-    TRY_CATCH_CALL(isolate, fmt->handle(), baton->callback, 3, argv);
+  Local<Object> buffer = fmt->pool->Wrap(isolate, baton->buffer, baton->formattedSamples * fmt->outAlignment, fmt->typedFormat);
+  baton->buffer = NULL;
+
+  if (baton->chunkSamples > baton->totalSamples) {
     BeginFormat(baton);
+    Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer), Local<Value>::New(isolate, Boolean::New(isolate, false)) };
+    TRY_CATCH_CALL(isolate, fmt->handle(), baton->callback, 3, argv);
     return;
   }
 
-  fmt->formatting = false;
-  Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer.ToLocalChecked()), Local<Value>::New(isolate, Boolean::New(isolate, true)) };
+  FinishFormat(baton, Local<Value>::New(isolate, buffer));
+}
+
+// Starts the next queued chunk, if any, then hands this one's last output
+// to JS and frees it.
+void Formatter::FinishFormat(FormatBaton* baton, Local<Value> output) {
+  Formatter* fmt = baton->fmt;
+  Isolate *isolate = fmt->isolate;
+
+  Baton* next = NULL;
+  if (fmt->queue.empty()) {
+    fmt->formatting = false;
+  } else {
+    next = fmt->queue.front();
+    fmt->queue.pop_front();
+    // A chunk with nothing to do would be done at once, ahead of this one,
+    // so it only starts after this one has been delivered.
+    if (static_cast<FormatBaton*>(next)->chunkSamples > 0) {
+      BeginFormat(next);
+      next = NULL;
+    }
+  }
+
+  Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), output, Local<Value>::New(isolate, Boolean::New(isolate, true)) };
   TRY_CATCH_CALL(isolate, fmt->handle(), baton->callback, 3, argv);
   delete baton;
+
+  if (next != NULL) BeginFormat(next);
 }
\ No newline at end of file
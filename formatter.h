@@ -2,13 +2,22 @@
 #define FORMATTER_H
 
 #include <cstdlib>
+#include <deque>
 #include <uv.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_object_wrap.h>
 #include "macros.h"
+#include "pool.h"
+#include "worker.h"
+#include "convert.h"
+#include "carry.h"
+#include "shard.h"
 
 #define FMT_BUFFER_SAMPLES 1024
+#define FMT_QUEUE_SIZE 4
+#define FMT_SHARD_SAMPLES 65536
+#define FMT_SYNC_SAMPLES 256
 
 using namespace v8;
 using namespace node;
@@ -23,17 +32,27 @@ public:
 
 protected:
   Formatter() : ObjectWrap(), inFormat(0), outFormat(0),
-      inAlignment(0), outAlignment(0), formatting(false), buffer(NULL) {
+      inAlignment(0), outAlignment(0), blockSamples(0), kernel(NULL), wholeChunk(false), typedFormat(-1), formatting(false), queueSize(0), parallel(0), syncThreshold(0), pool(NULL), carry(NULL), isolate(NULL), loop(NULL) {
   }
 
   ~Formatter() {
+    RemoveQueueOwner(this);
     inFormat = 0;
     outFormat = 0;
     inAlignment = 0;
     outAlignment = 0;
+    blockSamples = 0;
+    kernel = NULL;
+    wholeChunk = false;
+    typedFormat = -1;
     formatting = false;
-    if (buffer != NULL) free(buffer);
-    buffer = NULL;
+    queueSize = 0;
+    parallel = 0;
+    syncThreshold = 0;
+    if (pool != NULL) pool->Destroy();
+    pool = NULL;
+    if (carry != NULL) delete carry;
+    carry = NULL;
   }
 
   struct Baton {
@@ -54,36 +73,80 @@ protected:
     Persistent<Object> chunk;
     size_t chunkLength;
     char* chunkData;
+    char* head;
+    char* buffer;
+    int headSamples;
+    int chunkSamples;
+    int blockSamples;
     int totalSamples;
     int formattedSamples;
+    ShardSet shards;
 
     FormatBaton(Isolate* isolate, Formatter* fmt_, Handle<Function> cb_, Handle<Object> chunk_) : Baton(fmt_),
-        chunkLength(0), chunkData(NULL), totalSamples(0), formattedSamples(0) {
+        chunkLength(0), chunkData(NULL), head(NULL), buffer(NULL), headSamples(0), chunkSamples(0), blockSamples(0), totalSamples(0),
+        formattedSamples(0), shards(fmt_->parallel, FMT_SHARD_SAMPLES) {
 
       callback.Reset(isolate, cb_);
       chunk.Reset(isolate, chunk_);
       chunkData = Buffer::Data(chunk.Get(isolate));
       chunkLength = Buffer::Length(chunk.Get(isolate));
+
+      // A sample split across chunks is completed from this one and
+      // converted first, and this chunk's own partial sample waits for
+      // the next. Batons are built in submission order, so this is too.
+      size_t skip, bodySamples;
+      head = (char*)malloc(fmt->inAlignment);
+      headSamples = fmt->carry->Split(chunkData, chunkLength, head, &skip, &bodySamples) ? 1 : 0;
+      chunkData += skip;
+      chunkSamples = headSamples + bodySamples;
+
+      // In whole chunk mode the entire input is converted in one pass.
+      blockSamples = fmt->wholeChunk ? chunkSamples : fmt->blockSamples;
     }
     virtual ~FormatBaton() {
       callback.Reset();
       chunk.Reset();
+      free(head);
+      if (buffer != NULL) fmt->pool->Recycle(buffer, formattedSamples * fmt->outAlignment);
     }
   };
 
   static void New(const FunctionCallbackInfo<Value>& args);
+  static void CancelQueued(void* arg);
   static void Format(const FunctionCallbackInfo<Value>& args);
+  static void FormatSync(const FunctionCallbackInfo<Value>& args);
+
+  static void Release(const FunctionCallbackInfo<Value>& args);
+  static void PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SyncThresholdGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
 
   static void BeginFormat(Baton* baton);
+  static void FormatRange(FormatBaton* baton, int start, int samples, char* out);
   static void DoFormat(uv_work_t* req);
-  static void AfterFormat(uv_work_t* req);
+  static void AfterFormat(uv_work_t* req, int status);
+  static void FinishFormat(FormatBaton* baton, Local<Value> output);
+  static void DoFormatShard(uv_work_t* req);
+  static void AfterFormatShard(uv_work_t* req, int status);
 
   int inFormat;
   int outFormat;
   int inAlignment;
   int outAlignment;
+  int blockSamples;
+  ConvertKernel kernel;
+  bool wholeChunk;
+  int typedFormat;
   bool formatting;
-  char* buffer;
+  std::deque<Baton*> queue;
+  int queueSize;
+  int parallel;
+  int syncThreshold;
+  BufferPool* pool;
+  CarryBuffer* carry;
+  Isolate* isolate;
+  uv_loop_t* loop;
 };
 
 }
@@ -0,0 +1,357 @@
+#include "graph.h"
+
+using namespace pcmutils;
+
+void Graph::Init(Handle<Object> exports) {
+  Isolate *isolate = exports->GetIsolate();
+  Local<FunctionTemplate> tpl = FunctionTemplate::New(isolate, New);
+  tpl->InstanceTemplate()->SetInternalFieldCount(1);
+  tpl->SetClassName(String::NewFromUtf8(isolate, "Graph"));
+
+  InitConvertKernels();
+
+  NODE_SET_PROTOTYPE_METHOD(tpl, "process", Process);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", Release);
+
+  NODE_SET_GETTER(isolate, tpl, "pool", PoolGetter);
+  NODE_SET_GETTER(isolate, tpl, "outputChannels", OutputChannelsGetter);
+  NODE_SET_GETTER(isolate, tpl, "samplesPerBuffer", SamplesPerBufferGetter);
+  NODE_SET_GETTER(isolate, tpl, "saturated", SaturatedGetter);
+
+  exports->Set(String::NewFromUtf8(isolate, "Graph"), tpl->GetFunction());
+}
+
+void Graph::New(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  if (!args.IsConstructCall()) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Use the new operator")));
+    return;
+  }
+
+  REQUIRE_ARGUMENTS(isolate, 4);
+  OPTIONAL_ARGUMENT_OBJECT(isolate, 4, options);
+
+  if (!args[2]->IsArray() || !args[3]->IsArray()) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Stages and outputs must be arrays")));
+    return;
+  }
+
+  Graph* graph = new Graph();
+  graph->Wrap(args.This());
+  AddQueueOwner(graph, CancelQueued);
+  graph->isolate = isolate;
+  graph->loop = GetCurrentEventLoop(isolate);
+
+  graph->channels = args[0]->Int32Value();
+  graph->format = args[1]->Int32Value();
+  graph->alignment = FormatAlignment(graph->format);
+  graph->frameAlignment = graph->channels * graph->alignment;
+
+  if (graph->alignment == 0 || graph->channels < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Unsupported format")));
+    return;
+  }
+
+  // Everything is resolved here, so a bad graph fails now and not per chunk.
+  if (!graph->Build(isolate, Local<Array>::Cast(args[2]), Local<Array>::Cast(args[3]))) return;
+
+  graph->unzipKernel = GetDeinterleaveKernel(graph->channels, graph->alignment);
+  graph->zipKernel = GetInterleaveKernel(graph->outputPlanes.size(), graph->outAlignment);
+  graph->processing = false;
+
+  graph->blockFrames = OPTION_INT(isolate, options, "blockSize", GRAPH_BUFFER_FRAMES);
+  if (graph->blockFrames < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid block size")));
+    return;
+  }
+
+  graph->queueSize = OPTION_INT(isolate, options, "queueSize", GRAPH_QUEUE_SIZE);
+  if (graph->queueSize < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid queue size")));
+    return;
+  }
+
+  graph->carry = new CarryBuffer(graph->frameAlignment);
+  graph->pool = new BufferPool(OPTION_INT(isolate, options, "slabSize", graph->blockFrames * graph->outFrameAlignment));
+
+  args.GetReturnValue().Set(args.This());
+}
+
+void Graph::CancelQueued(void* arg) {
+  Graph* graph = static_cast<Graph*>(arg);
+  while (!graph->queue.empty()) {
+    delete graph->queue.front();
+    graph->queue.pop_front();
+  }
+}
+
+// Reads a list of plane indices, all of which must already exist and
+// share a format.
+static bool ParsePlanes(Local<Value> value, const std::vector<int>& formats, std::vector<int>& planes) {
+  if (!value->IsArray()) return false;
+  Local<Array> list = Local<Array>::Cast(value);
+  if (list->Length() == 0) return false;
+
+  for (uint32_t i = 0; i < list->Length(); i++) {
+    Local<Value> plane = list->Get(i);
+    if (!plane->IsNumber()) return false;
+    int index = plane->Int32Value();
+    if (index < 0 || index >= static_cast<int>(formats.size())) return false;
+    if (formats[index] != formats[planes.empty() ? index : planes[0]]) return false;
+    planes.push_back(index);
+  }
+  return true;
+}
+
+static bool ParseGains(Local<Value> value, size_t inputs, std::vector<float>& gains) {
+  if (!value->IsArray()) return false;
+  Local<Array> rows = Local<Array>::Cast(value);
+  if (rows->Length() == 0) return false;
+
+  for (uint32_t o = 0; o < rows->Length(); o++) {
+    Local<Value> row = rows->Get(o);
+    if (!row->IsArray() || Local<Array>::Cast(row)->Length() != inputs) return false;
+    for (uint32_t c = 0; c < inputs; c++) {
+      Local<Value> gain = Local<Array>::Cast(row)->Get(c);
+      if (!gain->IsNumber()) return false;
+      gains.push_back(static_cast<float>(gain->NumberValue()));
+    }
+  }
+  return true;
+}
+
+bool Graph::Build(Isolate* isolate, Local<Array> stageList, Local<Array> outputList) {
+  // Plane formats first, scratch memory is laid out once they're known.
+  std::vector<int> formats(channels, format);
+  std::vector<std::vector<int> > stageInputs(stageList->Length());
+  std::vector<std::vector<int> > stageOutputs(stageList->Length());
+  stages.resize(stageList->Length());
+
+  for (uint32_t s = 0; s < stageList->Length(); s++) {
+    Stage& stage = stages[s];
+    Local<Value> value = stageList->Get(s);
+    bool valid = value->IsObject();
+
+    if (valid) {
+      Local<Object> spec = value->ToObject();
+      valid = ParsePlanes(OPTION_VALUE(isolate, spec, "inputs"), formats, stageInputs[s]);
+      int inFormat = valid ? formats[stageInputs[s][0]] : 0;
+
+      if (valid && !OPTION_VALUE(isolate, spec, "format")->IsUndefined()) {
+        int outFormat = OPTION_VALUE(isolate, spec, "format")->Int32Value();
+        stage.type = STAGE_FORMAT;
+        stage.convert = GetConvertKernel(inFormat, outFormat);
+        valid = stage.convert != NULL;
+        for (size_t i = 0; valid && i < stageInputs[s].size(); i++) {
+          stageOutputs[s].push_back(formats.size());
+          formats.push_back(outFormat);
+        }
+      } else if (valid && !OPTION_VALUE(isolate, spec, "gains")->IsUndefined()) {
+        stage.type = STAGE_MIX;
+        stage.mix = GetMixKernel(inFormat);
+        valid = stage.mix != NULL && ParseGains(OPTION_VALUE(isolate, spec, "gains"), stageInputs[s].size(), stage.gains);
+        for (size_t o = 0; valid && o < stage.gains.size() / stageInputs[s].size(); o++) {
+          stageOutputs[s].push_back(formats.size());
+          formats.push_back(inFormat);
+        }
+      } else {
+        valid = false;
+      }
+    }
+
+    if (!valid) {
+      isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid stage")));
+      return false;
+    }
+  }
+
+  std::vector<int> outputs;
+  if (!ParsePlanes(outputList, formats, outputs)) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid outputs")));
+    return false;
+  }
+  outAlignment = FormatAlignment(formats[outputs[0]]);
+  outFrameAlignment = outputs.size() * outAlignment;
+
+  std::vector<size_t> offsets(formats.size());
+  size_t scratchSize = 0;
+  for (size_t p = 0; p < formats.size(); p++) {
+    offsets[p] = scratchSize;
+    scratchSize += GRAPH_BLOCK_FRAMES * FormatAlignment(formats[p]);
+  }
+  scratch = (char*)malloc(scratchSize);
+
+  for (int c = 0; c < channels; c++) inputPlanes.push_back(scratch + offsets[c]);
+  for (size_t i = 0; i < outputs.size(); i++) outputPlanes.push_back(scratch + offsets[outputs[i]]);
+  for (size_t s = 0; s < stages.size(); s++) {
+    for (size_t i = 0; i < stageInputs[s].size(); i++) stages[s].inputs.push_back(scratch + offsets[stageInputs[s][i]]);
+    for (size_t i = 0; i < stageOutputs[s].size(); i++) stages[s].outputs.push_back(scratch + offsets[stageOutputs[s][i]]);
+  }
+
+  return true;
+}
+
+void Graph::Process(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 2);
+  REQUIRE_ARGUMENT_FUNCTION(isolate, 1, callback);
+
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.Holder());
+
+  COND_ERR_CALL(isolate, graph->queue.size() >= static_cast<size_t>(graph->queueSize), callback, "Queue full");
+
+  ProcessBaton* baton = new ProcessBaton(isolate, graph, callback, args[0]->ToObject());
+  if (graph->processing) {
+    graph->queue.push_back(baton);
+  } else {
+    graph->processing = true;
+    BeginProcess(baton);
+  }
+
+  args.GetReturnValue().Set(Boolean::New(isolate, graph->queue.size() < static_cast<size_t>(graph->queueSize)));
+}
+
+void Graph::Release(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.Holder());
+  bool released = graph->pool->Release(isolate, args[0]);
+  args.GetReturnValue().Set(Boolean::New(isolate, released));
+}
+
+void Graph::PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.This());
+  args.GetReturnValue().Set(graph->pool->Stats(isolate));
+}
+
+void Graph::OutputChannelsGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, graph->outputPlanes.size()));
+}
+
+void Graph::SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, graph->blockFrames));
+}
+
+void Graph::SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Graph* graph = ObjectWrap::Unwrap<Graph>(args.This());
+  args.GetReturnValue().Set(Boolean::New(isolate, graph->queue.size() >= static_cast<size_t>(graph->queueSize)));
+}
+
+void Graph::BeginProcess(Baton* baton) {
+  ProcessBaton* procBaton = static_cast<ProcessBaton*>(baton);
+  Graph* graph = baton->graph;
+
+  if (procBaton->totalFrames == 0) {
+    HandleScope scope(graph->isolate);
+    FinishProcess(procBaton, Null(graph->isolate));
+    return;
+  }
+
+  // Each pass fills one pool slab, the output of a chunk is a series of blocks.
+  procBaton->passFrames = procBaton->totalFrames - procBaton->processedFrames;
+  if (procBaton->passFrames > graph->blockFrames) procBaton->passFrames = graph->blockFrames;
+
+  procBaton->buffer = graph->pool->Acquire(procBaton->passFrames * graph->outFrameAlignment);
+  QueueWork(graph->loop, &baton->request, DoProcess, AfterProcess);
+}
+
+void Graph::DoProcess(uv_work_t* req) {
+  ProcessBaton* baton = static_cast<ProcessBaton*>(req->data);
+  Graph* graph = baton->graph;
+
+  int start = baton->processedFrames;
+  int frames = baton->passFrames;
+  char* out = baton->buffer;
+
+  // The stitched frame, if any, comes before the rest of the chunk.
+  if (start < baton->headFrames && frames > 0) {
+    graph->ProcessFrames(baton->head, 1, out);
+    out += graph->outFrameAlignment;
+    start++;
+    frames--;
+  }
+
+  graph->ProcessFrames(baton->chunkData + (start - baton->headFrames) * graph->frameAlignment, frames, out);
+}
+
+void Graph::ProcessFrames(const char* in, int frames, char* out) {
+  for (int start = 0; start < frames; start += GRAPH_BLOCK_FRAMES) {
+    size_t run = frames - start < GRAPH_BLOCK_FRAMES ? frames - start : GRAPH_BLOCK_FRAMES;
+
+    unzipKernel(in + start * frameAlignment, &inputPlanes[0], run, channels, alignment);
+
+    for (size_t s = 0; s < stages.size(); s++) {
+      Stage& stage = stages[s];
+      if (stage.type == STAGE_FORMAT) {
+        for (size_t i = 0; i < stage.inputs.size(); i++) stage.convert(stage.inputs[i], stage.outputs[i], run);
+      } else {
+        // One plane per output, so each row is mixed on its own.
+        for (size_t o = 0; o < stage.outputs.size(); o++) {
+          stage.mix(&stage.inputs[0], stage.outputs[o], run, stage.inputs.size(), &stage.gains[o * stage.inputs.size()], 1);
+        }
+      }
+    }
+
+    zipKernel(&outputPlanes[0], out + start * outFrameAlignment, run, outputPlanes.size(), outAlignment);
+  }
+}
+
+void Graph::AfterProcess(uv_work_t* req, int status) {
+  ProcessBaton* baton = static_cast<ProcessBaton*>(req->data);
+
+  if (status == UV_ECANCELED) {
+    delete baton;
+    return;
+  }
+
+  Graph* graph = baton->graph;
+  Isolate *isolate = graph->isolate;
+  HandleScope scope(isolate);
+
+  baton->processedFrames += baton->passFrames;
+
+  Local<Object> buffer = graph->pool->Wrap(isolate, baton->buffer, baton->passFrames * graph->outFrameAlignment);
+  baton->buffer = NULL;
+
+  if (baton->totalFrames > baton->processedFrames) {
+    BeginProcess(baton);
+    Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer), Local<Value>::New(isolate, Boolean::New(isolate, false)) };
+    TRY_CATCH_CALL(isolate, graph->handle(), baton->callback, 3, argv);
+    return;
+  }
+
+  FinishProcess(baton, Local<Value>::New(isolate, buffer));
+}
+
+void Graph::FinishProcess(ProcessBaton* baton, Local<Value> output) {
+  Graph* graph = baton->graph;
+  Isolate *isolate = graph->isolate;
+
+  Baton* next = NULL;
+  if (graph->queue.empty()) {
+    graph->processing = false;
+  } else {
+    next = graph->queue.front();
+    graph->queue.pop_front();
+    if (static_cast<ProcessBaton*>(next)->totalFrames > 0) {
+      BeginProcess(next);
+      next = NULL;
+    }
+  }
+
+  Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), output, Local<Value>::New(isolate, Boolean::New(isolate, true)) };
+  TRY_CATCH_CALL(isolate, graph->handle(), baton->callback, 3, argv);
+  delete baton;
+
+  if (next != NULL) BeginProcess(next);
+}
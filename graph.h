@@ -0,0 +1,168 @@
+#ifndef GRAPH_H
+#define GRAPH_H
+
+#include <cstdlib>
+#include <vector>
+#include <deque>
+#include <uv.h>
+#include <node.h>
+#include <node_buffer.h>
+#include <node_object_wrap.h>
+#include "macros.h"
+#include "pool.h"
+#include "worker.h"
+#include "convert.h"
+#include "interleave.h"
+#include "mix.h"
+#include "carry.h"
+
+#define GRAPH_BUFFER_FRAMES 1024
+#define GRAPH_QUEUE_SIZE 4
+
+// Frames pushed through every stage at a time. Small enough that all the
+// intermediate planes of a typical graph stay in cache between stages.
+#define GRAPH_BLOCK_FRAMES 256
+
+using namespace v8;
+using namespace node;
+
+namespace pcmutils {
+
+class Graph;
+
+// Runs a fixed chain of stages over interleaved input in one worker task.
+// The input is unzipped into planes 0..channels-1, each stage reads some
+// planes and appends new ones, and the output planes are zipped back up.
+// Planes only ever live in per-instance scratch memory.
+class Graph : public ObjectWrap {
+public:
+  static void Init(Handle<Object> exports);
+
+protected:
+  Graph() : ObjectWrap(), channels(0), format(0), alignment(0), frameAlignment(0), outAlignment(0), outFrameAlignment(0), blockFrames(0),
+      scratch(NULL), unzipKernel(NULL), zipKernel(NULL), processing(false), queueSize(0), pool(NULL), carry(NULL), isolate(NULL), loop(NULL) {
+  }
+
+  ~Graph() {
+    RemoveQueueOwner(this);
+    channels = 0;
+    format = 0;
+    alignment = 0;
+    frameAlignment = 0;
+    outAlignment = 0;
+    outFrameAlignment = 0;
+    blockFrames = 0;
+    if (scratch != NULL) free(scratch);
+    scratch = NULL;
+    unzipKernel = NULL;
+    zipKernel = NULL;
+    processing = false;
+    queueSize = 0;
+    if (pool != NULL) pool->Destroy();
+    pool = NULL;
+    if (carry != NULL) delete carry;
+    carry = NULL;
+  }
+
+  enum StageType { STAGE_FORMAT, STAGE_MIX };
+
+  struct Stage {
+    StageType type;
+    std::vector<const char*> inputs;
+    std::vector<char*> outputs;
+    ConvertKernel convert;
+    MixKernel mix;
+    std::vector<float> gains;
+  };
+
+  struct Baton {
+    uv_work_t request;
+    Graph* graph;
+
+    Baton(Graph* graph_) : graph(graph_) {
+      graph->Ref();
+      request.data = this;
+    }
+    virtual ~Baton() {
+      graph->Unref();
+    }
+  };
+
+  struct ProcessBaton : Baton {
+    Persistent<Function> callback;
+    Persistent<Object> chunk;
+    char* chunkData;
+    char* head;
+    char* buffer;
+    int headFrames;
+    int totalFrames;
+    int processedFrames;
+    int passFrames;
+
+    ProcessBaton(Isolate* isolate, Graph* graph_, Handle<Function> cb_, Handle<Object> chunk_) : Baton(graph_),
+        chunkData(NULL), head(NULL), buffer(NULL), headFrames(0), totalFrames(0), processedFrames(0), passFrames(0) {
+
+      callback.Reset(isolate, cb_);
+      chunk.Reset(isolate, chunk_);
+      chunkData = Buffer::Data(chunk.Get(isolate));
+
+      // A frame split across chunks is completed from this one and run
+      // first, and this chunk's own partial frame waits for the next.
+      // Batons are built in submission order, so this is too.
+      size_t skip, bodyFrames;
+      head = (char*)malloc(graph->frameAlignment);
+      headFrames = graph->carry->Split(chunkData, Buffer::Length(chunk.Get(isolate)), head, &skip, &bodyFrames) ? 1 : 0;
+      chunkData += skip;
+      totalFrames = headFrames + bodyFrames;
+    }
+    virtual ~ProcessBaton() {
+      callback.Reset();
+      chunk.Reset();
+      free(head);
+      if (buffer != NULL) graph->pool->Recycle(buffer, passFrames * graph->outFrameAlignment);
+    }
+  };
+
+  static void New(const FunctionCallbackInfo<Value>& args);
+  static void CancelQueued(void* arg);
+  static void Process(const FunctionCallbackInfo<Value>& args);
+
+  static void Release(const FunctionCallbackInfo<Value>& args);
+  static void PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void OutputChannelsGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+
+  bool Build(Isolate* isolate, Local<Array> stages, Local<Array> outputs);
+
+  static void BeginProcess(Baton* baton);
+  void ProcessFrames(const char* in, int frames, char* out);
+  static void DoProcess(uv_work_t* req);
+  static void AfterProcess(uv_work_t* req, int status);
+  static void FinishProcess(ProcessBaton* baton, Local<Value> output);
+
+  int channels;
+  int format;
+  int alignment;
+  int frameAlignment;
+  int outAlignment;
+  int outFrameAlignment;
+  int blockFrames;
+  char* scratch;
+  std::vector<char*> inputPlanes;
+  std::vector<const char*> outputPlanes;
+  std::vector<Stage> stages;
+  DeinterleaveKernel unzipKernel;
+  InterleaveKernel zipKernel;
+  bool processing;
+  std::deque<Baton*> queue;
+  int queueSize;
+  BufferPool* pool;
+  CarryBuffer* carry;
+  Isolate* isolate;
+  uv_loop_t* loop;
+};
+
+}
+
+#endif
@@ -0,0 +1,461 @@
+#include <stdint.h>
+#include <cstring>
+#include "interleave.h"
+#include "cpu.h"
+
+#ifdef PCM_X86
+#include <immintrin.h>
+#endif
+
+using namespace pcmutils;
+
+// Scalar versions, which the SIMD ones fall back to for leftover samples.
+
+template <typename T>
+static void DeinterleaveTyped(const char* in, char** out, size_t start, size_t frames, int channels) {
+  const T* src = static_cast<const T*>(static_cast<const void*>(in));
+  for (int channel = 0; channel < channels; channel++) {
+    T* dst = static_cast<T*>(static_cast<void*>(out[channel]));
+    for (size_t i = start; i < frames; i++) dst[i] = src[i * channels + channel];
+  }
+}
+
+// Packed 24-bit samples have no matching type, a fixed size copy lets the
+// compiler turn each one into a couple of plain moves.
+template <int N>
+static void DeinterleavePacked(const char* in, char** out, size_t start, size_t frames, int channels) {
+  for (int channel = 0; channel < channels; channel++) {
+    const char* src = in + channel * N;
+    for (size_t i = start; i < frames; i++) memcpy(out[channel] + i * N, src + i * channels * N, N);
+  }
+}
+
+static void DeinterleaveRange(const char* in, char** out, size_t start, size_t frames, int channels, int alignment) {
+  if (alignment == 1) {
+    DeinterleaveTyped<uint8_t>(in, out, start, frames, channels);
+  } else if (alignment == 2) {
+    DeinterleaveTyped<uint16_t>(in, out, start, frames, channels);
+  } else if (alignment == 3) {
+    DeinterleavePacked<3>(in, out, start, frames, channels);
+  } else if (alignment == 4) {
+    DeinterleaveTyped<uint32_t>(in, out, start, frames, channels);
+  } else if (alignment == 8) {
+    DeinterleaveTyped<uint64_t>(in, out, start, frames, channels);
+  } else {
+    int frameAlignment = channels * alignment;
+    for (int channel = 0; channel < channels; channel++) {
+      for (size_t i = start; i < frames; i++) {
+        memcpy(out[channel] + i * alignment, in + i * frameAlignment + channel * alignment, alignment);
+      }
+    }
+  }
+}
+
+static void GenericDeinterleave(const char* in, char** out, size_t frames, int channels, int alignment) {
+  DeinterleaveRange(in, out, 0, frames, channels, alignment);
+}
+
+template <typename T>
+static void InterleaveTyped(const char* const* in, char* out, size_t start, size_t frames, int channels) {
+  T* dst = static_cast<T*>(static_cast<void*>(out));
+  for (int channel = 0; channel < channels; channel++) {
+    const T* src = static_cast<const T*>(static_cast<const void*>(in[channel]));
+    for (size_t i = start; i < frames; i++) dst[i * channels + channel] = src[i];
+  }
+}
+
+template <int N>
+static void InterleavePacked(const char* const* in, char* out, size_t start, size_t frames, int channels) {
+  for (int channel = 0; channel < channels; channel++) {
+    char* dst = out + channel * N;
+    for (size_t i = start; i < frames; i++) memcpy(dst + i * channels * N, in[channel] + i * N, N);
+  }
+}
+
+static void InterleaveRange(const char* const* in, char* out, size_t start, size_t frames, int channels, int alignment) {
+  if (alignment == 1) {
+    InterleaveTyped<uint8_t>(in, out, start, frames, channels);
+  } else if (alignment == 2) {
+    InterleaveTyped<uint16_t>(in, out, start, frames, channels);
+  } else if (alignment == 3) {
+    InterleavePacked<3>(in, out, start, frames, channels);
+  } else if (alignment == 4) {
+    InterleaveTyped<uint32_t>(in, out, start, frames, channels);
+  } else if (alignment == 8) {
+    InterleaveTyped<uint64_t>(in, out, start, frames, channels);
+  } else {
+    int frameAlignment = channels * alignment;
+    for (int channel = 0; channel < channels; channel++) {
+      for (size_t i = start; i < frames; i++) {
+        memcpy(out + i * frameAlignment + channel * alignment, in[channel] + i * alignment, alignment);
+      }
+    }
+  }
+}
+
+static void GenericInterleave(const char* const* in, char* out, size_t frames, int channels, int alignment) {
+  InterleaveRange(in, out, 0, frames, channels, alignment);
+}
+
+#ifdef PCM_X86
+
+// SSE2 kernels.
+
+// Transposes 8 rows of 8 16-bit samples, in place.
+PCM_TARGET("sse2")
+static inline void Transpose8x16(__m128i* r) {
+  __m128i t0 = _mm_unpacklo_epi16(r[0], r[1]);
+  __m128i t1 = _mm_unpackhi_epi16(r[0], r[1]);
+  __m128i t2 = _mm_unpacklo_epi16(r[2], r[3]);
+  __m128i t3 = _mm_unpackhi_epi16(r[2], r[3]);
+  __m128i t4 = _mm_unpacklo_epi16(r[4], r[5]);
+  __m128i t5 = _mm_unpackhi_epi16(r[4], r[5]);
+  __m128i t6 = _mm_unpacklo_epi16(r[6], r[7]);
+  __m128i t7 = _mm_unpackhi_epi16(r[6], r[7]);
+
+  __m128i u0 = _mm_unpacklo_epi32(t0, t2);
+  __m128i u1 = _mm_unpackhi_epi32(t0, t2);
+  __m128i u2 = _mm_unpacklo_epi32(t1, t3);
+  __m128i u3 = _mm_unpackhi_epi32(t1, t3);
+  __m128i u4 = _mm_unpacklo_epi32(t4, t6);
+  __m128i u5 = _mm_unpackhi_epi32(t4, t6);
+  __m128i u6 = _mm_unpacklo_epi32(t5, t7);
+  __m128i u7 = _mm_unpackhi_epi32(t5, t7);
+
+  r[0] = _mm_unpacklo_epi64(u0, u4);
+  r[1] = _mm_unpackhi_epi64(u0, u4);
+  r[2] = _mm_unpacklo_epi64(u1, u5);
+  r[3] = _mm_unpackhi_epi64(u1, u5);
+  r[4] = _mm_unpacklo_epi64(u2, u6);
+  r[5] = _mm_unpackhi_epi64(u2, u6);
+  r[6] = _mm_unpacklo_epi64(u3, u7);
+  r[7] = _mm_unpackhi_epi64(u3, u7);
+}
+
+// Transposes 4 rows of 4 32-bit samples, in place.
+PCM_TARGET("sse2")
+static inline void Transpose4x32(__m128* r) {
+  _MM_TRANSPOSE4_PS(r[0], r[1], r[2], r[3]);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Deinterleave2x16(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i a = _mm_loadu_si128((const __m128i*)(in + i * 4));
+    __m128i b = _mm_loadu_si128((const __m128i*)(in + i * 4 + 16));
+    // Sign-extend the even and odd halves of each frame, then pack.
+    __m128i left = _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(a, 16), 16), _mm_srai_epi32(_mm_slli_epi32(b, 16), 16));
+    __m128i right = _mm_packs_epi32(_mm_srai_epi32(a, 16), _mm_srai_epi32(b, 16));
+    _mm_storeu_si128((__m128i*)(out[0] + i * 2), left);
+    _mm_storeu_si128((__m128i*)(out[1] + i * 2), right);
+  }
+  DeinterleaveRange(in, out, i, frames, 2, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Deinterleave2x32(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 a = _mm_loadu_ps((const float*)(in + i * 8));
+    __m128 b = _mm_loadu_ps((const float*)(in + i * 8 + 16));
+    _mm_storeu_ps((float*)(out[0] + i * 4), _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    _mm_storeu_ps((float*)(out[1] + i * 4), _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+  }
+  DeinterleaveRange(in, out, i, frames, 2, 4);
+}
+
+// 6 channel frames are loaded as 8 samples, so the last two lanes of each
+// row spill into the next frame. Stopping a frame early keeps every load
+// inside the input.
+PCM_TARGET("sse2")
+static void Sse2Deinterleave6x16(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128i r[8];
+  for (; i + 9 <= frames; i += 8) {
+    for (int f = 0; f < 8; f++) r[f] = _mm_loadu_si128((const __m128i*)(in + (i + f) * 12));
+    Transpose8x16(r);
+    for (int c = 0; c < 6; c++) _mm_storeu_si128((__m128i*)(out[c] + i * 2), r[c]);
+  }
+  DeinterleaveRange(in, out, i, frames, 6, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Deinterleave8x16(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128i r[8];
+  for (; i + 8 <= frames; i += 8) {
+    for (int f = 0; f < 8; f++) r[f] = _mm_loadu_si128((const __m128i*)(in + (i + f) * 16));
+    Transpose8x16(r);
+    for (int c = 0; c < 8; c++) _mm_storeu_si128((__m128i*)(out[c] + i * 2), r[c]);
+  }
+  DeinterleaveRange(in, out, i, frames, 8, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Deinterleave6x32(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128 lo[4], hi[4];
+  for (; i + 5 <= frames; i += 4) {
+    for (int f = 0; f < 4; f++) {
+      lo[f] = _mm_loadu_ps((const float*)(in + (i + f) * 24));
+      hi[f] = _mm_loadu_ps((const float*)(in + (i + f) * 24 + 16));
+    }
+    Transpose4x32(lo);
+    Transpose4x32(hi);
+    for (int c = 0; c < 4; c++) _mm_storeu_ps((float*)(out[c] + i * 4), lo[c]);
+    for (int c = 0; c < 2; c++) _mm_storeu_ps((float*)(out[c + 4] + i * 4), hi[c]);
+  }
+  DeinterleaveRange(in, out, i, frames, 6, 4);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Deinterleave8x32(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128 lo[4], hi[4];
+  for (; i + 4 <= frames; i += 4) {
+    for (int f = 0; f < 4; f++) {
+      lo[f] = _mm_loadu_ps((const float*)(in + (i + f) * 32));
+      hi[f] = _mm_loadu_ps((const float*)(in + (i + f) * 32 + 16));
+    }
+    Transpose4x32(lo);
+    Transpose4x32(hi);
+    for (int c = 0; c < 4; c++) {
+      _mm_storeu_ps((float*)(out[c] + i * 4), lo[c]);
+      _mm_storeu_ps((float*)(out[c + 4] + i * 4), hi[c]);
+    }
+  }
+  DeinterleaveRange(in, out, i, frames, 8, 4);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave2x16(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i left = _mm_loadu_si128((const __m128i*)(in[0] + i * 2));
+    __m128i right = _mm_loadu_si128((const __m128i*)(in[1] + i * 2));
+    _mm_storeu_si128((__m128i*)(out + i * 4), _mm_unpacklo_epi16(left, right));
+    _mm_storeu_si128((__m128i*)(out + i * 4 + 16), _mm_unpackhi_epi16(left, right));
+  }
+  InterleaveRange(in, out, i, frames, 2, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave2x32(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 4 <= frames; i += 4) {
+    __m128 left = _mm_loadu_ps((const float*)(in[0] + i * 4));
+    __m128 right = _mm_loadu_ps((const float*)(in[1] + i * 4));
+    _mm_storeu_ps((float*)(out + i * 8), _mm_unpacklo_ps(left, right));
+    _mm_storeu_ps((float*)(out + i * 8 + 16), _mm_unpackhi_ps(left, right));
+  }
+  InterleaveRange(in, out, i, frames, 2, 4);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave4x16(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m128i c0 = _mm_loadu_si128((const __m128i*)(in[0] + i * 2));
+    __m128i c1 = _mm_loadu_si128((const __m128i*)(in[1] + i * 2));
+    __m128i c2 = _mm_loadu_si128((const __m128i*)(in[2] + i * 2));
+    __m128i c3 = _mm_loadu_si128((const __m128i*)(in[3] + i * 2));
+    __m128i a0 = _mm_unpacklo_epi16(c0, c1);
+    __m128i a1 = _mm_unpackhi_epi16(c0, c1);
+    __m128i b0 = _mm_unpacklo_epi16(c2, c3);
+    __m128i b1 = _mm_unpackhi_epi16(c2, c3);
+    _mm_storeu_si128((__m128i*)(out + i * 8), _mm_unpacklo_epi32(a0, b0));
+    _mm_storeu_si128((__m128i*)(out + i * 8 + 16), _mm_unpackhi_epi32(a0, b0));
+    _mm_storeu_si128((__m128i*)(out + i * 8 + 32), _mm_unpacklo_epi32(a1, b1));
+    _mm_storeu_si128((__m128i*)(out + i * 8 + 48), _mm_unpackhi_epi32(a1, b1));
+  }
+  InterleaveRange(in, out, i, frames, 4, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave4x32(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128 r[4];
+  for (; i + 4 <= frames; i += 4) {
+    for (int c = 0; c < 4; c++) r[c] = _mm_loadu_ps((const float*)(in[c] + i * 4));
+    Transpose4x32(r);
+    for (int f = 0; f < 4; f++) _mm_storeu_ps((float*)(out + (i + f) * 16), r[f]);
+  }
+  InterleaveRange(in, out, i, frames, 4, 4);
+}
+
+// 6 channel frames are stored as 8 samples, the last two lanes of each row
+// spilling into the next frame, which overwrites them right after. Stopping
+// a frame early keeps every store inside the output.
+PCM_TARGET("sse2")
+static void Sse2Interleave6x16(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128i r[8];
+  for (; i + 9 <= frames; i += 8) {
+    for (int c = 0; c < 6; c++) r[c] = _mm_loadu_si128((const __m128i*)(in[c] + i * 2));
+    r[6] = r[7] = _mm_setzero_si128();
+    Transpose8x16(r);
+    for (int f = 0; f < 8; f++) _mm_storeu_si128((__m128i*)(out + (i + f) * 12), r[f]);
+  }
+  InterleaveRange(in, out, i, frames, 6, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave8x16(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128i r[8];
+  for (; i + 8 <= frames; i += 8) {
+    for (int c = 0; c < 8; c++) r[c] = _mm_loadu_si128((const __m128i*)(in[c] + i * 2));
+    Transpose8x16(r);
+    for (int f = 0; f < 8; f++) _mm_storeu_si128((__m128i*)(out + (i + f) * 16), r[f]);
+  }
+  InterleaveRange(in, out, i, frames, 8, 2);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave6x32(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128 lo[4], hi[4];
+  for (; i + 5 <= frames; i += 4) {
+    for (int c = 0; c < 4; c++) lo[c] = _mm_loadu_ps((const float*)(in[c] + i * 4));
+    for (int c = 0; c < 2; c++) hi[c] = _mm_loadu_ps((const float*)(in[c + 4] + i * 4));
+    hi[2] = hi[3] = _mm_setzero_ps();
+    Transpose4x32(lo);
+    Transpose4x32(hi);
+    for (int f = 0; f < 4; f++) {
+      _mm_storeu_ps((float*)(out + (i + f) * 24), lo[f]);
+      _mm_storeu_ps((float*)(out + (i + f) * 24 + 16), hi[f]);
+    }
+  }
+  InterleaveRange(in, out, i, frames, 6, 4);
+}
+
+PCM_TARGET("sse2")
+static void Sse2Interleave8x32(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  __m128 lo[4], hi[4];
+  for (; i + 4 <= frames; i += 4) {
+    for (int c = 0; c < 4; c++) {
+      lo[c] = _mm_loadu_ps((const float*)(in[c] + i * 4));
+      hi[c] = _mm_loadu_ps((const float*)(in[c + 4] + i * 4));
+    }
+    Transpose4x32(lo);
+    Transpose4x32(hi);
+    for (int f = 0; f < 4; f++) {
+      _mm_storeu_ps((float*)(out + (i + f) * 32), lo[f]);
+      _mm_storeu_ps((float*)(out + (i + f) * 32 + 16), hi[f]);
+    }
+  }
+  InterleaveRange(in, out, i, frames, 8, 4);
+}
+
+// AVX2 kernels, stereo only. Packs, unpacks and shuffles work per 128-bit
+// lane, so the lanes are put back in order afterwards.
+
+PCM_TARGET("avx2")
+static void Avx2Deinterleave2x16(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 16 <= frames; i += 16) {
+    __m256i a = _mm256_loadu_si256((const __m256i*)(in + i * 4));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(in + i * 4 + 32));
+    __m256i left = _mm256_packs_epi32(_mm256_srai_epi32(_mm256_slli_epi32(a, 16), 16), _mm256_srai_epi32(_mm256_slli_epi32(b, 16), 16));
+    __m256i right = _mm256_packs_epi32(_mm256_srai_epi32(a, 16), _mm256_srai_epi32(b, 16));
+    _mm256_storeu_si256((__m256i*)(out[0] + i * 2), _mm256_permute4x64_epi64(left, 0xD8));
+    _mm256_storeu_si256((__m256i*)(out[1] + i * 2), _mm256_permute4x64_epi64(right, 0xD8));
+  }
+  char* tail[2] = { out[0] + i * 2, out[1] + i * 2 };
+  Sse2Deinterleave2x16(in + i * 4, tail, frames - i, 2, 2);
+}
+
+PCM_TARGET("avx2")
+static void Avx2Deinterleave2x32(const char* in, char** out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 a = _mm256_loadu_ps((const float*)(in + i * 8));
+    __m256 b = _mm256_loadu_ps((const float*)(in + i * 8 + 32));
+    __m256d left = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+    __m256d right = _mm256_castps_pd(_mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    _mm256_storeu_pd((double*)(out[0] + i * 4), _mm256_permute4x64_pd(left, 0xD8));
+    _mm256_storeu_pd((double*)(out[1] + i * 4), _mm256_permute4x64_pd(right, 0xD8));
+  }
+  char* tail[2] = { out[0] + i * 4, out[1] + i * 4 };
+  Sse2Deinterleave2x32(in + i * 8, tail, frames - i, 2, 4);
+}
+
+PCM_TARGET("avx2")
+static void Avx2Interleave2x16(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 16 <= frames; i += 16) {
+    __m256i left = _mm256_loadu_si256((const __m256i*)(in[0] + i * 2));
+    __m256i right = _mm256_loadu_si256((const __m256i*)(in[1] + i * 2));
+    __m256i lo = _mm256_unpacklo_epi16(left, right);
+    __m256i hi = _mm256_unpackhi_epi16(left, right);
+    _mm256_storeu_si256((__m256i*)(out + i * 4), _mm256_permute2x128_si256(lo, hi, 0x20));
+    _mm256_storeu_si256((__m256i*)(out + i * 4 + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+  }
+  const char* tail[2] = { in[0] + i * 2, in[1] + i * 2 };
+  Sse2Interleave2x16(tail, out + i * 4, frames - i, 2, 2);
+}
+
+PCM_TARGET("avx2")
+static void Avx2Interleave2x32(const char* const* in, char* out, size_t frames, int /* channels */, int /* alignment */) {
+  size_t i = 0;
+  for (; i + 8 <= frames; i += 8) {
+    __m256 left = _mm256_loadu_ps((const float*)(in[0] + i * 4));
+    __m256 right = _mm256_loadu_ps((const float*)(in[1] + i * 4));
+    __m256 lo = _mm256_unpacklo_ps(left, right);
+    __m256 hi = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps((float*)(out + i * 8), _mm256_permute2f128_ps(lo, hi, 0x20));
+    _mm256_storeu_ps((float*)(out + i * 8 + 32), _mm256_permute2f128_ps(lo, hi, 0x31));
+  }
+  const char* tail[2] = { in[0] + i * 4, in[1] + i * 4 };
+  Sse2Interleave2x32(tail, out + i * 8, frames - i, 2, 4);
+}
+
+#endif
+
+DeinterleaveKernel pcmutils::GetDeinterleaveKernel(int channels, int alignment) {
+#ifdef PCM_X86
+  const CpuFeatures& cpu = GetCpuFeatures();
+
+  if (cpu.avx2) {
+    if (channels == 2 && alignment == 2) return Avx2Deinterleave2x16;
+    if (channels == 2 && alignment == 4) return Avx2Deinterleave2x32;
+  }
+
+  if (cpu.sse2) {
+    if (channels == 2 && alignment == 2) return Sse2Deinterleave2x16;
+    if (channels == 2 && alignment == 4) return Sse2Deinterleave2x32;
+    if (channels == 6 && alignment == 2) return Sse2Deinterleave6x16;
+    if (channels == 6 && alignment == 4) return Sse2Deinterleave6x32;
+    if (channels == 8 && alignment == 2) return Sse2Deinterleave8x16;
+    if (channels == 8 && alignment == 4) return Sse2Deinterleave8x32;
+  }
+#endif
+
+  return GenericDeinterleave;
+}
+
+InterleaveKernel pcmutils::GetInterleaveKernel(int channels, int alignment) {
+#ifdef PCM_X86
+  const CpuFeatures& cpu = GetCpuFeatures();
+
+  if (cpu.avx2) {
+    if (channels == 2 && alignment == 2) return Avx2Interleave2x16;
+    if (channels == 2 && alignment == 4) return Avx2Interleave2x32;
+  }
+
+  if (cpu.sse2) {
+    if (channels == 2 && alignment == 2) return Sse2Interleave2x16;
+    if (channels == 2 && alignment == 4) return Sse2Interleave2x32;
+    if (channels == 4 && alignment == 2) return Sse2Interleave4x16;
+    if (channels == 4 && alignment == 4) return Sse2Interleave4x32;
+    if (channels == 6 && alignment == 2) return Sse2Interleave6x16;
+    if (channels == 6 && alignment == 4) return Sse2Interleave6x32;
+    if (channels == 8 && alignment == 2) return Sse2Interleave8x16;
+    if (channels == 8 && alignment == 4) return Sse2Interleave8x32;
+  }
+#endif
+
+  return GenericInterleave;
+}
\ No newline at end of file
@@ -0,0 +1,22 @@
+#ifndef INTERLEAVE_H
+#define INTERLEAVE_H
+
+#include <cstddef>
+
+namespace pcmutils {
+
+// Splits `frames` interleaved frames from `in` into one plane per channel.
+// Specialized kernels ignore `channels` and `alignment`, the generic one
+// handles any layout.
+typedef void (*DeinterleaveKernel)(const char* in, char** out, size_t frames, int channels, int alignment);
+
+// Merges one plane per channel from `in` into `frames` interleaved frames.
+typedef void (*InterleaveKernel)(const char* const* in, char* out, size_t frames, int channels, int alignment);
+
+// Pick the fastest kernel for the layout the CPU can run. Never NULL.
+DeinterleaveKernel GetDeinterleaveKernel(int channels, int alignment);
+InterleaveKernel GetInterleaveKernel(int channels, int alignment);
+
+}
+
+#endif
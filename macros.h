@@ -27,9 +27,10 @@
 
 #define COND_ERR_CALL(isolate, condition, callback, message)                   \
   if (condition) {                                                             \
-    if ((callback).IsEmpty() || !(callback)->IsFunction())                     \
+    if ((callback).IsEmpty() || !(callback)->IsFunction()) {                   \
       isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, message)));       \
       return;                                                                  \
+    }                                                                          \
     Local<Value> exception = Exception::Error(String::NewFromUtf8(isolate, message));           \
     Local<Value> argv[1] = { Local<Value>::New(isolate, exception) };          \
     TRY_CATCH_CALL(isolate, args.Holder(), (callback), 1, argv);               \
@@ -57,10 +58,34 @@
   }                                                                            \
   Local<Function> var = Local<Function>::Cast(args[i]);
 
+#define OPTIONAL_ARGUMENT_OBJECT(isolate, i, var)                              \
+  Local<Object> var;                                                           \
+  if (args.Length() > i && !args[i]->IsUndefined()) {                          \
+    if (!args[i]->IsObject()) {                                                \
+      isolate->ThrowException(Exception::TypeError(                            \
+        String::NewFromUtf8(isolate, "Argument " #i " must be an object"))     \
+      );                                                                       \
+      return;                                                                  \
+    }                                                                          \
+    var = args[i]->ToObject();                                                 \
+  }
+
+#define OPTION_VALUE(isolate, options, name)                                   \
+  ((options).IsEmpty() ? Local<Value>::Cast(Undefined(isolate))                \
+    : (options)->Get(String::NewFromUtf8(isolate, name)))
+
+#define OPTION_BOOL(isolate, options, name, def)                               \
+  (OPTION_VALUE(isolate, options, name)->IsUndefined() ? (def)                 \
+    : OPTION_VALUE(isolate, options, name)->BooleanValue())
+
+#define OPTION_INT(isolate, options, name, def)                                \
+  (OPTION_VALUE(isolate, options, name)->IsUndefined() ? (def)                 \
+    : OPTION_VALUE(isolate, options, name)->Int32Value())
+
 #define TRY_CATCH_CALL(isolate, context, callback, argc, argv)                 \
 {   TryCatch try_catch;                                                        \
     Local<Function>::New(isolate, callback)->Call(isolate->GetCurrentContext(), (context), (argc), (argv));              \
-    if (try_catch.HasCaught()) {                                               \
+    if (try_catch.HasCaught() && !try_catch.HasTerminated()) {                 \
         FatalException(isolate, try_catch);                                    \
     }                                                                          }
 
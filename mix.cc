@@ -0,0 +1,325 @@
+#include "mix.h"
+#include "simd.h"
+
+using namespace pcmutils;
+
+// Samples are accumulated a block at a time, so the running sums stay in
+// cache however many inputs there are.
+#define MIX_BLOCK_SAMPLES 256
+
+// Float formats accumulate in their own precision. Integer formats sum
+// their left-justified values, which a float holds exactly up to 24 bits,
+// and saturate on the way out. Wider ones accumulate in double.
+template <class Codec, bool Float = Codec::isFloat, bool Wide = Codec::wide>
+struct Accumulator {
+  typedef float Type;
+  static inline float Load(const char* in) { return Codec::ToFloat(in); }
+  static inline void Store(float value, char* out) { Codec::FromFloat(value, out); }
+};
+
+template <class Codec>
+struct Accumulator<Codec, true, true> {
+  typedef double Type;
+  static inline double Load(const char* in) { return Codec::ToDouble(in); }
+  static inline void Store(double value, char* out) { Codec::FromDouble(value, out); }
+};
+
+template <class Codec, bool Wide>
+struct Accumulator<Codec, false, Wide> {
+  typedef typename Accumulator<Codec, true, Wide>::Type Type;
+  static inline Type Load(const char* in) { return static_cast<Type>(Codec::ToInt(in)); }
+  static inline void Store(Type value, char* out) {
+    if (!(value > static_cast<Type>(-2147483648.0))) {
+      Codec::FromInt(-2147483647 - 1, out);
+    } else if (value >= static_cast<Type>(2147483648.0)) {
+      Codec::FromInt(2147483647, out);
+    } else {
+      Codec::FromInt(static_cast<int32_t>(value), out);
+    }
+  }
+};
+
+// Generic kernels. Byte order and companding are handled by the codec
+// loads and stores, so every format runs the same multiply-accumulate.
+template <class Codec>
+static void MixGeneric(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs) {
+  typedef Accumulator<Codec> Acc;
+  typename Acc::Type sum[MIX_BLOCK_SAMPLES];
+  const size_t stride = outputs * Codec::size;
+
+  for (size_t start = 0; start < samples; start += MIX_BLOCK_SAMPLES) {
+    size_t n = samples - start < MIX_BLOCK_SAMPLES ? samples - start : MIX_BLOCK_SAMPLES;
+
+    for (int o = 0; o < outputs; o++) {
+      const float* row = gains + o * inputs;
+      for (size_t i = 0; i < n; i++) sum[i] = 0;
+
+      for (int c = 0; c < inputs; c++) {
+        if (row[c] == 0) continue;
+        typename Acc::Type gain = row[c];
+        const char* src = in[c] + start * Codec::size;
+        for (size_t i = 0; i < n; i++) sum[i] += gain * Acc::Load(src + i * Codec::size);
+      }
+
+      char* dst = out + start * stride + o * Codec::size;
+      for (size_t i = 0; i < n; i++) Acc::Store(sum[i], dst + i * stride);
+    }
+  }
+}
+
+// Mixes one output over a range of samples, for the tails of the
+// vectorized kernels.
+template <class Codec>
+static void MixTail(const char* const* in, char* out, size_t start, size_t samples, int inputs, const float* row, size_t stride) {
+  typedef Accumulator<Codec> Acc;
+  for (size_t i = start; i < samples; i++) {
+    typename Acc::Type sum = 0;
+    for (int c = 0; c < inputs; c++) sum += row[c] * Acc::Load(in[c] + i * Codec::size);
+    Acc::Store(sum, out + i * stride);
+  }
+}
+
+static MixKernel SelectGeneric(int format) {
+#define MIX_FORMAT_CASE(format, codec)                                         \
+  case format: return MixGeneric<codec>;
+
+  switch (format) {
+    PCM_FORMATS(MIX_FORMAT_CASE)
+  }
+  return NULL;
+
+#undef MIX_FORMAT_CASE
+}
+
+#ifdef PCM_X86
+
+// Native float kernels. Each output is summed in registers across every
+// input before it is stored, so nothing but the inputs is read back.
+
+static inline void StoreLanes(const void* lanes, char* out, size_t count, int size, size_t stride) {
+  for (size_t k = 0; k < count; k++) memcpy(out + k * stride, static_cast<const char*>(lanes) + k * size, size);
+}
+
+PCM_TARGET("sse2")
+static void Sse2MixF32(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs) {
+  const size_t stride = outputs * 4;
+  float lanes[4];
+
+  for (int o = 0; o < outputs; o++) {
+    const float* row = gains + o * inputs;
+    char* dst = out + o * 4;
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+      __m128 sum = _mm_setzero_ps();
+      for (int c = 0; c < inputs; c++) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps((const float*)(in[c] + i * 4)), _mm_set1_ps(row[c])));
+      }
+      if (outputs == 1) {
+        _mm_storeu_ps((float*)(dst + i * 4), sum);
+      } else {
+        _mm_storeu_ps(lanes, sum);
+        StoreLanes(lanes, dst + i * stride, 4, 4, stride);
+      }
+    }
+    MixTail<F32LE>(in, dst, i, samples, inputs, row, stride);
+  }
+}
+
+PCM_TARGET("avx2")
+static void Avx2MixF32(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs) {
+  const size_t stride = outputs * 4;
+  float lanes[8];
+
+  for (int o = 0; o < outputs; o++) {
+    const float* row = gains + o * inputs;
+    char* dst = out + o * 4;
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+      __m256 sum = _mm256_setzero_ps();
+      for (int c = 0; c < inputs; c++) {
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps((const float*)(in[c] + i * 4)), _mm256_set1_ps(row[c])));
+      }
+      if (outputs == 1) {
+        _mm256_storeu_ps((float*)(dst + i * 4), sum);
+      } else {
+        _mm256_storeu_ps(lanes, sum);
+        StoreLanes(lanes, dst + i * stride, 8, 4, stride);
+      }
+    }
+    MixTail<F32LE>(in, dst, i, samples, inputs, row, stride);
+  }
+}
+
+// 16-bit integer kernels. Samples are widened to 32-bit lanes and never
+// scaled down per input, so quiet inputs keep their low bits. When every
+// input of an output has the same gain, as with the default average, the
+// inputs are summed as integers and the gain is applied once per sample.
+// Results are floored like the integer shifts of the generic kernel and
+// saturate when packed back to 16 bits.
+
+static inline bool UniformRow(const float* row, int inputs) {
+  for (int c = 1; c < inputs; c++) {
+    if (row[c] != row[0]) return false;
+  }
+  return true;
+}
+
+PCM_TARGET("sse2")
+static inline __m128i Sse2FloorToS32(__m128 value) {
+  const __m128 top = _mm_set1_ps(32767.0f);
+  const __m128 bottom = _mm_set1_ps(-32768.0f);
+  value = _mm_min_ps(_mm_max_ps(value, bottom), top);
+  __m128i truncated = _mm_cvttps_epi32(value);
+  __m128 above = _mm_cmpgt_ps(_mm_cvtepi32_ps(truncated), value);
+  return _mm_add_epi32(truncated, _mm_castps_si128(above));
+}
+
+template <bool BE, bool U>
+PCM_TARGET("sse2")
+static inline __m128i Sse2LoadPcm16(const char* in) {
+  const __m128i flip = _mm_set1_epi16(U ? (short)0x8000 : 0);
+  return _mm_xor_si128(Sse2Swap16<BE>(_mm_loadu_si128((const __m128i*)in)), flip);
+}
+
+template <bool BE, bool U>
+PCM_TARGET("sse2")
+static void Sse2MixPcm16(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs) {
+  const __m128i flip = _mm_set1_epi16(U ? (short)0x8000 : 0);
+  const size_t stride = outputs * 2;
+  int16_t lanes[8];
+
+  for (int o = 0; o < outputs; o++) {
+    const float* row = gains + o * inputs;
+    const bool uniform = UniformRow(row, inputs);
+    const __m128 common = _mm_set1_ps(row[0]);
+    char* dst = out + o * 2;
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+      __m128 lo, hi;
+      if (uniform) {
+        __m128i sumLo = _mm_setzero_si128();
+        __m128i sumHi = _mm_setzero_si128();
+        for (int c = 0; c < inputs; c++) {
+          __m128i value = Sse2LoadPcm16<BE, U>(in[c] + i * 2);
+          sumLo = _mm_add_epi32(sumLo, _mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16));
+          sumHi = _mm_add_epi32(sumHi, _mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16));
+        }
+        lo = _mm_mul_ps(_mm_cvtepi32_ps(sumLo), common);
+        hi = _mm_mul_ps(_mm_cvtepi32_ps(sumHi), common);
+      } else {
+        lo = hi = _mm_setzero_ps();
+        for (int c = 0; c < inputs; c++) {
+          __m128 gain = _mm_set1_ps(row[c]);
+          __m128i value = Sse2LoadPcm16<BE, U>(in[c] + i * 2);
+          lo = _mm_add_ps(lo, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(value, value), 16)), gain));
+          hi = _mm_add_ps(hi, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(value, value), 16)), gain));
+        }
+      }
+
+      __m128i packed = _mm_packs_epi32(Sse2FloorToS32(lo), Sse2FloorToS32(hi));
+      packed = Sse2Swap16<BE>(_mm_xor_si128(packed, flip));
+      if (outputs == 1) {
+        _mm_storeu_si128((__m128i*)(dst + i * 2), packed);
+      } else {
+        _mm_storeu_si128((__m128i*)lanes, packed);
+        StoreLanes(lanes, dst + i * stride, 8, 2, stride);
+      }
+    }
+    MixTail<typename Pcm16<U, BE>::Codec>(in, dst, i, samples, inputs, row, stride);
+  }
+}
+
+PCM_TARGET("avx2")
+static inline __m256i Avx2FloorToS32(__m256 value) {
+  const __m256 top = _mm256_set1_ps(32767.0f);
+  const __m256 bottom = _mm256_set1_ps(-32768.0f);
+  value = _mm256_min_ps(_mm256_max_ps(value, bottom), top);
+  return _mm256_cvtps_epi32(_mm256_floor_ps(value));
+}
+
+template <bool BE, bool U>
+PCM_TARGET("avx2")
+static inline __m256i Avx2LoadPcm16(const char* in) {
+  const __m256i flip = _mm256_set1_epi16(U ? (short)0x8000 : 0);
+  return _mm256_xor_si256(Avx2Swap16<BE>(_mm256_loadu_si256((const __m256i*)in)), flip);
+}
+
+template <bool BE, bool U>
+PCM_TARGET("avx2")
+static void Avx2MixPcm16(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs) {
+  const __m256i flip = _mm256_set1_epi16(U ? (short)0x8000 : 0);
+  const size_t stride = outputs * 2;
+  int16_t lanes[16];
+
+  for (int o = 0; o < outputs; o++) {
+    const float* row = gains + o * inputs;
+    const bool uniform = UniformRow(row, inputs);
+    const __m256 common = _mm256_set1_ps(row[0]);
+    char* dst = out + o * 2;
+    size_t i = 0;
+    for (; i + 16 <= samples; i += 16) {
+      __m256 lo, hi;
+      if (uniform) {
+        __m256i sumLo = _mm256_setzero_si256();
+        __m256i sumHi = _mm256_setzero_si256();
+        for (int c = 0; c < inputs; c++) {
+          __m256i value = Avx2LoadPcm16<BE, U>(in[c] + i * 2);
+          sumLo = _mm256_add_epi32(sumLo, _mm256_cvtepi16_epi32(_mm256_castsi256_si128(value)));
+          sumHi = _mm256_add_epi32(sumHi, _mm256_cvtepi16_epi32(_mm256_extracti128_si256(value, 1)));
+        }
+        lo = _mm256_mul_ps(_mm256_cvtepi32_ps(sumLo), common);
+        hi = _mm256_mul_ps(_mm256_cvtepi32_ps(sumHi), common);
+      } else {
+        lo = hi = _mm256_setzero_ps();
+        for (int c = 0; c < inputs; c++) {
+          __m256 gain = _mm256_set1_ps(row[c]);
+          __m256i value = Avx2LoadPcm16<BE, U>(in[c] + i * 2);
+          lo = _mm256_add_ps(lo, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_castsi256_si128(value))), gain));
+          hi = _mm256_add_ps(hi, _mm256_mul_ps(_mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm256_extracti128_si256(value, 1))), gain));
+        }
+      }
+
+      // Undo the lane-wise interleave of packs.
+      __m256i packed = _mm256_packs_epi32(Avx2FloorToS32(lo), Avx2FloorToS32(hi));
+      packed = _mm256_permute4x64_epi64(packed, 0xD8);
+      packed = Avx2Swap16<BE>(_mm256_xor_si256(packed, flip));
+      if (outputs == 1) {
+        _mm256_storeu_si256((__m256i*)(dst + i * 2), packed);
+      } else {
+        _mm256_storeu_si256((__m256i*)lanes, packed);
+        StoreLanes(lanes, dst + i * stride, 16, 2, stride);
+      }
+    }
+    MixTail<typename Pcm16<U, BE>::Codec>(in, dst, i, samples, inputs, row, stride);
+  }
+}
+
+#endif
+
+MixKernel pcmutils::GetMixKernel(int format) {
+#ifdef PCM_X86
+  const CpuFeatures& cpu = GetCpuFeatures();
+
+  if (cpu.avx2) {
+    switch (format) {
+      case FMT_F32LE: return Avx2MixF32;
+      case FMT_S16LE: return Avx2MixPcm16<false, false>;
+      case FMT_S16BE: return Avx2MixPcm16<true, false>;
+      case FMT_U16LE: return Avx2MixPcm16<false, true>;
+      case FMT_U16BE: return Avx2MixPcm16<true, true>;
+    }
+  }
+
+  if (cpu.sse2) {
+    switch (format) {
+      case FMT_F32LE: return Sse2MixF32;
+      case FMT_S16LE: return Sse2MixPcm16<false, false>;
+      case FMT_S16BE: return Sse2MixPcm16<true, false>;
+      case FMT_U16LE: return Sse2MixPcm16<false, true>;
+      case FMT_U16BE: return Sse2MixPcm16<true, true>;
+    }
+  }
+#endif
+
+  return SelectGeneric(format);
+}
@@ -0,0 +1,21 @@
+#ifndef MIX_H
+#define MIX_H
+
+#include <cstddef>
+#include "codecs.h"
+
+namespace pcmutils {
+
+// Mixes `inputs` planes of `samples` samples from `in` into `outputs`
+// interleaved channels in `out`. `gains` is row-major, one row of `inputs`
+// gains per output. Neither pointer needs to be aligned. Inputs are only
+// ever read, so the same buffers can feed several mixers at once.
+typedef void (*MixKernel)(const char* const* in, char* out, size_t samples, int inputs, const float* gains, int outputs);
+
+// Picks the fastest kernel for the format the CPU can run. Returns NULL
+// for unsupported formats.
+MixKernel GetMixKernel(int format);
+
+}
+
+#endif
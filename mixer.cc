@@ -9,12 +9,23 @@ void Mixer::Init(Handle<Object> exports) {
   tpl->InstanceTemplate()->SetInternalFieldCount(1);
   tpl->SetClassName(String::NewFromUtf8(isolate, "Mixer"));
 
+  InitCodecTables();
+
   NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "flush", Flush);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "mixSync", MixSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isReady", IsReady);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", Release);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setGain", SetGain);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "setGains", SetGains);
 
-  NODE_SET_GETTER(isolate, tpl, "channelBuffers", ChannelBuffersGetter);
   NODE_SET_GETTER(isolate, tpl, "channelsReady", ChannelsReadyGetter);
   NODE_SET_GETTER(isolate, tpl, "samplesPerBuffer", SamplesPerBufferGetter);
+  NODE_SET_GETTER(isolate, tpl, "pool", PoolGetter);
   NODE_SET_GETTER(isolate, tpl, "mixing", MixingGetter);
+  NODE_SET_GETTER(isolate, tpl, "saturated", SaturatedGetter);
+  NODE_SET_GETTER(isolate, tpl, "outputs", OutputsGetter);
+  NODE_SET_GETTER(isolate, tpl, "gains", GainsGetter);
 
   // Persistent<Function> constructor = Persistent<Function>::New(isolate, tpl->GetFunction());
   exports->Set(String::NewFromUtf8(isolate, "Mixer"), tpl->GetFunction());
@@ -30,45 +41,104 @@ void Mixer::New(const FunctionCallbackInfo<Value>& args) {
 
   REQUIRE_ARGUMENTS(isolate, 4);
   REQUIRE_ARGUMENT_FUNCTION(isolate, 3, callback);
+  OPTIONAL_ARGUMENT_OBJECT(isolate, 4, options);
 
   Mixer* mix = new Mixer();
   mix->Wrap(args.This());
+  AddQueueOwner(mix, CancelQueued);
+  mix->isolate = isolate;
+  mix->loop = GetCurrentEventLoop(isolate);
 
   mix->channels = args[0]->Int32Value();
+  mix->outputs = OPTION_INT(isolate, options, "outputs", 1);
+  mix->frameChannels = OPTION_INT(isolate, options, "interleaved", 1);
+  mix->blockSamples = OPTION_INT(isolate, options, "blockSize", MIX_BUFFER_SAMPLES);
   mix->alignment = args[1]->Int32Value();
+  mix->frameAlignment = mix->outputs * mix->alignment;
   mix->format = args[2]->Int32Value();
+  mix->kernel = GetMixKernel(mix->format);
+  mix->typedFormat = OPTION_BOOL(isolate, options, "typed", false) ? mix->format : -1;
+  if (mix->typedFormat >= 0 && !HasTypedView(mix->typedFormat)) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "No typed array for this format")));
+    return;
+  }
+
+  if (mix->kernel == NULL) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Unsupported format")));
+    return;
+  }
+
+  if (mix->blockSamples < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid block size")));
+    return;
+  }
 
-  if (mix->format % 2 > 0) {
-    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Big-Endian formats currently unsupported by Mixer")));
+  if (mix->channels < 1 || mix->outputs < 1 || mix->frameChannels < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid channel count")));
     return;
   }
 
+  // Interleaved inputs mix channel for channel into the same layout, so
+  // there is only one output and one gain per input.
+  if (mix->frameChannels > 1 && mix->outputs != 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Interleaved mixing has a single output")));
+    return;
+  }
+
+  // Without a matrix every output is the average of all the inputs.
+  mix->gains = (float*)malloc(mix->outputs * mix->channels * sizeof(float));
+  for (int i = 0; i < mix->outputs * mix->channels; i++) {
+    mix->gains[i] = 1.0f / mix->channels;
+  }
+
+  Local<Value> gains = OPTION_VALUE(isolate, options, "gains");
+  if (!gains->IsUndefined() && !mix->ParseGains(isolate, gains)) return;
+
   mix->callback.Reset(isolate, callback);
   mix->mixing = false;
+  mix->queueSize = OPTION_INT(isolate, options, "queueSize", MIX_QUEUE_SIZE);
+  if (mix->queueSize < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid queue size")));
+    return;
+  }
 
-  mix->channelBuffers.Reset(isolate, Array::New(isolate, mix->channels));
+  mix->syncBlocks = mix->blockSamples <= OPTION_INT(isolate, options, "syncThreshold", MIX_SYNC_SAMPLES);
 
-  mix->channelsReady.Reset(isolate, Array::New(isolate, mix->channels));
+  // Each input buffers a few blocks ahead, so writes can be of any size.
+  int fifoBlocks = OPTION_INT(isolate, options, "fifoSize", MIX_FIFO_BLOCKS);
+  if (fifoBlocks < 1) fifoBlocks = 1;
+  mix->fifos = (Fifo**)malloc(mix->channels * sizeof(Fifo*));
   for (int i = 0; i < mix->channels; i++) {
-    mix->channelsReady.Get(isolate)->Set(i, Boolean::New(isolate, false));
+    mix->fifos[i] = new Fifo(fifoBlocks * mix->blockSamples * mix->frameChannels * mix->alignment);
   }
 
+  mix->pool = new BufferPool(OPTION_INT(isolate, options, "slabSize", mix->blockSamples * mix->frameChannels * mix->frameAlignment));
+
   args.GetReturnValue().Set(args.This());
 }
 
-void Mixer::ChannelBuffersGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
-  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
-  args.GetReturnValue().Set(mix->channelBuffers);
+void Mixer::CancelQueued(void* arg) {
+  Mixer* mix = static_cast<Mixer*>(arg);
+  while (!mix->queue.empty()) {
+    delete mix->queue.front();
+    mix->queue.pop_front();
+  }
 }
 
 void Mixer::ChannelsReadyGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
   Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
-  args.GetReturnValue().Set(mix->channelsReady);
+  Local<Array> ready = Array::New(isolate, mix->channels);
+  for (int i = 0; i < mix->channels; i++) {
+    ready->Set(i, Boolean::New(isolate, mix->fifos[i]->Readable() >= static_cast<size_t>(mix->blockSamples * mix->frameChannels * mix->alignment)));
+  }
+  args.GetReturnValue().Set(ready);
 }
 
 void Mixer::SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
-  args.GetReturnValue().Set(Integer::New(isolate, MIX_BUFFER_SAMPLES));
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, mix->blockSamples));
 }
 
 void Mixer::MixingGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
@@ -77,6 +147,38 @@ void Mixer::MixingGetter(Local<String>, const PropertyCallbackInfo<Value>& args)
   args.GetReturnValue().Set(Boolean::New(isolate, mix->mixing));
 }
 
+void Mixer::SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
+  args.GetReturnValue().Set(Boolean::New(isolate, mix->queue.size() >= static_cast<size_t>(mix->queueSize)));
+}
+
+void Mixer::OutputsGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, mix->outputs));
+}
+
+void Mixer::GainsGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
+  Local<Array> matrix = Array::New(isolate, mix->outputs);
+  for (int o = 0; o < mix->outputs; o++) {
+    Local<Array> row = Array::New(isolate, mix->channels);
+    for (int c = 0; c < mix->channels; c++) {
+      row->Set(c, Number::New(isolate, mix->gains[o * mix->channels + c]));
+    }
+    matrix->Set(o, row);
+  }
+  args.GetReturnValue().Set(matrix);
+}
+
+void Mixer::PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.This());
+  args.GetReturnValue().Set(mix->pool->Stats(isolate));
+}
+
 void Mixer::Write(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
 
@@ -85,124 +187,280 @@ void Mixer::Write(const FunctionCallbackInfo<Value>& args) {
 
   Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
 
-  COND_ERR_CALL(isolate, mix->mixing, callback, "Still mixing");
   int channel = args[0]->Int32Value();
-  COND_ERR_CALL(isolate, mix->channelsReady.Get(isolate)->Get(channel)->BooleanValue(), callback, "Already Ready");
+  COND_ERR_CALL(isolate, channel < 0 || channel >= mix->channels, callback, "Invalid channel");
+  COND_ERR_CALL(isolate, !Buffer::HasInstance(args[1]), callback, "Invalid buffer");
 
-  mix->channelBuffers.Get(isolate)->Set(channel, args[1]->ToObject());
-  mix->channelsReady.Get(isolate)->Set(channel, Boolean::New(isolate, true));
+  // Whatever doesn't fit is left to the caller, to write again once a
+  // block has been mixed and its space released.
+  size_t written = mix->fifos[channel]->Write(Buffer::Data(args[1]), Buffer::Length(args[1]));
 
-  WriteBaton* baton = new WriteBaton(isolate, mix, callback, channel);
-  BeginWrite(baton);
+  if (!callback.IsEmpty()) {
+    Local<Value> argv[1] = { v8::Local<v8::Value>() };
+    TRY_CATCH_CALL(isolate, mix->handle(), callback, 0, argv);
+  }
 
-  args.GetReturnValue().Set(args.Holder());
-}
+  mix->Schedule();
+  mix->End();
 
-void Mixer::BeginWrite(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoWrite, (uv_after_work_cb)AfterWrite);
+  args.GetReturnValue().Set(Integer::New(isolate, written));
 }
 
-void Mixer::DoWrite(uv_work_t* req) {
-  // Just a hop thru the evq
+// Mixes what is left once the inputs have ended, down to the last whole
+// frame every input has.
+void Mixer::Flush(const FunctionCallbackInfo<Value>& args) {
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
+  mix->flushing = true;
+  mix->Schedule();
+  mix->End();
 }
 
-void Mixer::AfterWrite(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
-  WriteBaton* baton = static_cast<WriteBaton*>(req->data);
-  Mixer* mix = baton->mix;
+// Mixes one block now if every input has it buffered and none are in
+// flight, returning null otherwise. Output is the same as from the callback.
+void Mixer::MixSync(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
 
-  if (!baton->callback.IsEmpty() && baton->callback.Get(isolate)->IsFunction()) {
-    Local<Value> argv[1] = { v8::Local<v8::Value>() };
-    TRY_CATCH_CALL(isolate, mix->handle(), baton->callback, 0, argv);
+  int samples = mix->blockSamples * mix->frameChannels;
+  if (mix->mixing || mix->Readable() < static_cast<size_t>(samples * mix->alignment)) {
+    args.GetReturnValue().Set(Null(isolate));
+    return;
   }
 
-  if (!mix->mixing) {
-    bool ready = true;
-    for (int i = 0; i < mix->channels; i++) {
-      if (!mix->channelsReady.Get(isolate)->Get(i)->BooleanValue()) ready = false;
+  args.GetReturnValue().Set(mix->MixBlock(samples));
+}
+
+// Least any input has buffered, only that much can be mixed.
+size_t Mixer::Readable() {
+  size_t readable = fifos[0]->Readable();
+  for (int i = 1; i < channels; i++) {
+    if (fifos[i]->Readable() < readable) readable = fifos[i]->Readable();
+  }
+  return readable;
+}
+
+// Readiness is decided right here on the JS thread, so the threadpool is
+// only used once every input has a whole block buffered.
+void Mixer::Schedule() {
+  // Delivering a block inline can write or flush again and land back here.
+  // The loop already running picks up whatever that added instead.
+  if (scheduling) return;
+  scheduling = true;
+
+  size_t blockBytes = blockSamples * frameChannels * alignment;
+
+  for (;;) {
+    size_t readable = Readable();
+
+    int samples = blockSamples * frameChannels;
+    if (readable < blockBytes) {
+      if (!flushing) break;
+      samples = readable / alignment;
+      samples -= samples % frameChannels;
+      if (samples == 0) break;
+    } else if (!flushing && mixing && queue.size() >= static_cast<size_t>(queueSize)) {
+      break;
     }
 
-    if (ready) {
-      MixBaton* mixBaton = new MixBaton(isolate, mix);
-      mix->mixing = true;
-      BeginMix(mixBaton);
+    if (!syncBlocks) {
+      Enqueue(new MixBaton(this, samples));
+      continue;
     }
+
+    // Delivered before the next block is looked at, which keeps blocks in
+    // order even if the callback writes more.
+    HandleScope scope(isolate);
+    Local<Object> buffer = MixBlock(samples);
+    if (!callback.IsEmpty()) {
+      Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer) };
+      TRY_CATCH_CALL(isolate, handle(), callback, 2, argv);
+    }
+  }
+
+  scheduling = false;
+}
+
+// Once flushed, and with every block delivered, the callback is called
+// one last time without a block.
+void Mixer::End() {
+  if (!flushing || ended || scheduling || mixing || !queue.empty()) return;
+  ended = true;
+
+  HandleScope scope(isolate);
+  if (!callback.IsEmpty()) {
+    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, Null(isolate)) };
+    TRY_CATCH_CALL(isolate, handle(), callback, 2, argv);
   }
+}
+
+// Mixes a block on the calling thread, with the same baton a worker uses.
+Local<Object> Mixer::MixBlock(int samples) {
+  MixBaton* baton = new MixBaton(this, samples);
+  DoMix(&baton->request);
 
+  Local<Object> buffer = pool->Wrap(isolate, baton->buffer, samples * frameAlignment, typedFormat);
+  baton->buffer = NULL;
   delete baton;
+  return buffer;
 }
 
-void Mixer::BeginMix(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoMix, (uv_after_work_cb)AfterMix);
+void Mixer::Enqueue(MixBaton* baton) {
+  if (mixing) {
+    queue.push_back(baton);
+  } else {
+    mixing = true;
+    BeginMix(baton);
+  }
 }
 
-void Mixer::DoMix(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  MixBaton* baton = static_cast<MixBaton*>(req->data);
-  Mixer* mix = baton->mix;
+void Mixer::IsReady(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
 
-  // Save back into first channel buffer
-  if (mix->format == 0) {
-    float* out = static_cast<float*>(static_cast<void*>(baton->channelData[0]));
-    float sum;
-    for (int i = 0; i < MIX_BUFFER_SAMPLES; i++) {
-      sum = 0;
-      for (int c = 0; c < mix->channels; c++) {
-        float* in = static_cast<float*>(static_cast<void*>(baton->channelData[c]));
-        sum += in[i] / mix->channels;
-      }
-      out[i] = sum;
-    }
-  } else if (mix->format == 2) {
-    int16_t* out = static_cast<int16_t*>(static_cast<void*>(baton->channelData[0]));
-    int16_t sum;
-    for (int i = 0; i < MIX_BUFFER_SAMPLES; i++) {
-      sum = 0;
-      for (int c = 0; c < mix->channels; c++) {
-        int16_t* in = static_cast<int16_t*>(static_cast<void*>(baton->channelData[c]));
-        sum += in[i] / mix->channels;
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
+  int channel = args[0]->Int32Value();
+  bool ready = channel >= 0 && channel < mix->channels &&
+      mix->fifos[channel]->Readable() >= static_cast<size_t>(mix->blockSamples * mix->frameChannels * mix->alignment);
+  args.GetReturnValue().Set(Boolean::New(isolate, ready));
+}
+
+void Mixer::Release(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
+  bool released = mix->pool->Release(isolate, args[0]);
+  args.GetReturnValue().Set(Boolean::New(isolate, released));
+}
+
+// Accepts one row of input gains per output, or all of them flattened in
+// the same order. Nothing is changed unless the whole matrix is valid.
+bool Mixer::ParseGains(Isolate* isolate, Local<Value> matrix) {
+  int cells = outputs * channels;
+  float* parsed = (float*)malloc(cells * sizeof(float));
+  bool valid = matrix->IsArray();
+
+  if (valid) {
+    Local<Array> rows = Local<Array>::Cast(matrix);
+    if (rows->Length() == static_cast<uint32_t>(cells)) {
+      for (int i = 0; valid && i < cells; i++) {
+        Local<Value> gain = rows->Get(i);
+        valid = gain->IsNumber();
+        if (valid) parsed[i] = static_cast<float>(gain->NumberValue());
       }
-      out[i] = sum;
-    }
-  } else if (mix->format == 4) {
-    uint16_t* out = static_cast<uint16_t*>(static_cast<void*>(baton->channelData[0]));
-    uint16_t sum;
-    for (int i = 0; i < MIX_BUFFER_SAMPLES; i++) {
-      sum = 0;
-      for (int c = 0; c < mix->channels; c++) {
-        uint16_t* in = static_cast<uint16_t*>(static_cast<void*>(baton->channelData[c]));
-        sum += (in[i] - 32768) / mix->channels;
+    } else if (rows->Length() == static_cast<uint32_t>(outputs)) {
+      for (int o = 0; valid && o < outputs; o++) {
+        Local<Value> row = rows->Get(o);
+        valid = row->IsArray() && Local<Array>::Cast(row)->Length() == static_cast<uint32_t>(channels);
+        for (int c = 0; valid && c < channels; c++) {
+          Local<Value> gain = Local<Array>::Cast(row)->Get(c);
+          valid = gain->IsNumber();
+          if (valid) parsed[o * channels + c] = static_cast<float>(gain->NumberValue());
+        }
       }
-      out[i] = sum + 32768;
+    } else {
+      valid = false;
     }
-  } else {
-    fprintf(stderr, "Unsupported format\n");
   }
+
+  if (!valid) {
+    free(parsed);
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Gains must be an outputs x channels matrix")));
+    return false;
+  }
+
+  memcpy(gains, parsed, cells * sizeof(float));
+  free(parsed);
+  return true;
 }
 
-void Mixer::AfterMix(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
+void Mixer::SetGain(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 3);
+
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
+  int output = args[0]->Int32Value();
+  int channel = args[1]->Int32Value();
+
+  if (output < 0 || output >= mix->outputs || channel < 0 || channel >= mix->channels || !args[2]->IsNumber()) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid gain")));
+    return;
+  }
+
+  // Takes effect from the next mix, the one in flight has its own copy.
+  mix->gains[output * mix->channels + channel] = static_cast<float>(args[2]->NumberValue());
+  args.GetReturnValue().Set(args.Holder());
+}
+
+void Mixer::SetGains(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Mixer* mix = ObjectWrap::Unwrap<Mixer>(args.Holder());
+  if (!mix->ParseGains(isolate, args[0])) return;
+  args.GetReturnValue().Set(args.Holder());
+}
+
+void Mixer::BeginMix(Baton* baton) {
+  QueueWork(baton->mix->loop, &baton->request, DoMix, AfterMix);
+}
+
+void Mixer::DoMix(uv_work_t* req) {
   MixBaton* baton = static_cast<MixBaton*>(req->data);
   Mixer* mix = baton->mix;
 
-  size_t blen = Buffer::Length(mix->channelBuffers.Get(isolate)->Get(0)->ToObject());
-  MaybeLocal<Object> buffer = Buffer::New(isolate, Buffer::Data(mix->channelBuffers.Get(isolate)->Get(0)->ToObject()), blen);
+  // Each input may wrap around its FIFO at a different point, the block is
+  // mixed in as many runs as it takes to stay contiguous in all of them.
+  int done = 0;
+  while (done < baton->samples) {
+    int run = baton->samples - done;
+    for (int i = 0; i < mix->channels; i++) {
+      size_t pos = baton->starts[i] + done * mix->alignment;
+      baton->channelData[i] = mix->fifos[i]->At(pos);
+      int contiguous = mix->fifos[i]->Contiguous(pos) / mix->alignment;
+      if (contiguous < run) run = contiguous;
+    }
 
-  for (int i = 0; i < mix->channels; i++) {
-    mix->channelsReady.Get(isolate)->Set(i, Boolean::New(isolate, false));
+    mix->kernel(baton->channelData, baton->buffer + done * mix->frameAlignment, run, mix->channels, baton->gains, mix->outputs);
+    done += run;
   }
+}
 
-  for (int i = 0; i < mix->channels; i++) {
-    mix->channelBuffers.Get(isolate)->Set(i, Local<Value>::New(isolate, Null(isolate)));
+void Mixer::AfterMix(uv_work_t* req, int status) {
+  MixBaton* baton = static_cast<MixBaton*>(req->data);
+
+  if (status == UV_ECANCELED) {
+    delete baton;
+    return;
   }
 
-  mix->mixing = false;
+  Mixer* mix = baton->mix;
+  Isolate *isolate = mix->isolate;
+  HandleScope scope(isolate);
+
+  Local<Object> buffer = mix->pool->Wrap(isolate, baton->buffer, baton->samples * mix->frameAlignment, mix->typedFormat);
+  baton->buffer = NULL;
+
+  if (mix->queue.empty()) {
+    mix->mixing = false;
+  } else {
+    Baton* next = mix->queue.front();
+    mix->queue.pop_front();
+    BeginMix(next);
+  }
+
+  // Frees the block's space in the FIFOs, which may make room for more.
   delete baton;
+  mix->Schedule();
 
   if (!mix->callback.IsEmpty()) {
-    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer.ToLocalChecked()) };
+    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer) };
     TRY_CATCH_CALL(isolate, mix->handle(), mix->callback, 2, argv);
   }
+
+  mix->End();
 }
\ No newline at end of file
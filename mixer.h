@@ -2,13 +2,22 @@
 #define MIXER_H
 
 #include <cstdlib>
+#include <cstring>
+#include <deque>
 #include <uv.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_object_wrap.h>
 #include "macros.h"
+#include "pool.h"
+#include "worker.h"
+#include "mix.h"
+#include "fifo.h"
 
 #define MIX_BUFFER_SAMPLES 1024
+#define MIX_QUEUE_SIZE 4
+#define MIX_FIFO_BLOCKS 8
+#define MIX_SYNC_SAMPLES 256
 
 using namespace v8;
 using namespace node;
@@ -22,19 +31,37 @@ public:
   static void Init(Handle<Object> exports);
 
 protected:
-  Mixer() : ObjectWrap(), channels(0), alignment(0), format(0), mixing(false) {
-    channelBuffers.Reset();
-    channelsReady.Reset();
+  Mixer() : ObjectWrap(), pool(NULL), fifos(NULL), channels(0), outputs(0), frameChannels(0), blockSamples(0), alignment(0), frameAlignment(0), format(0),
+      gains(NULL), kernel(NULL), typedFormat(-1), mixing(false), queueSize(0), syncBlocks(false), scheduling(false), flushing(false), ended(false), isolate(NULL), loop(NULL) {
     callback.Reset();
   }
 
   ~Mixer() {
-    channels = 0;
+    RemoveQueueOwner(this);
+    outputs = 0;
+    frameChannels = 0;
+    blockSamples = 0;
     alignment = 0;
+    frameAlignment = 0;
     format = 0;
+    if (gains != NULL) free(gains);
+    gains = NULL;
+    kernel = NULL;
+    typedFormat = -1;
     mixing = false;
-    channelBuffers.Reset();
-    channelsReady.Reset();
+    queueSize = 0;
+    syncBlocks = false;
+    scheduling = false;
+    flushing = false;
+    ended = false;
+    if (fifos != NULL) {
+      for (int i = 0; i < channels; i++) delete fifos[i];
+      free(fifos);
+    }
+    fifos = NULL;
+    channels = 0;
+    if (pool != NULL) pool->Destroy();
+    pool = NULL;
     callback.Reset();
   }
 
@@ -51,54 +78,91 @@ protected:
     }
   };
 
-  struct WriteBaton : Baton {
-    Persistent<Function> callback;
-    int channel;
-
-    WriteBaton(Isolate* isolate, Mixer* mix_, Handle<Function> cb_, int channel_) : Baton(mix_), channel(channel_) {
-      callback.Reset(isolate, cb_);
-    }
-    virtual ~WriteBaton() {
-      callback.Reset();
-    }
-  };
-
   struct MixBaton : Baton {
-    char** channelData;
-
-    MixBaton(Isolate* isolate, Mixer* mix_) : Baton(mix_), channelData(NULL) {
-      channelData = (char**)malloc(mix->channels * sizeof(char*));
+    const char** channelData;
+    size_t* starts;
+    char* buffer;
+    float* gains;
+    int samples;
+
+    MixBaton(Mixer* mix_, int samples_) : Baton(mix_), channelData(NULL), starts(NULL), buffer(NULL), gains(NULL), samples(samples_) {
+      // The block is read in place from each input's FIFO, which keeps the
+      // range until the baton is done with it.
+      channelData = (const char**)malloc(mix->channels * sizeof(char*));
+      starts = (size_t*)malloc(mix->channels * sizeof(size_t));
       for (int i = 0; i < mix->channels; i++) {
-        channelData[i] = Buffer::Data(mix->channelBuffers.Get(isolate)->Get(i)->ToObject());
+        starts[i] = mix->fifos[i]->Read(samples * mix->alignment);
       }
+
+      // Gains can change from JS while the mix runs, it gets its own copy.
+      size_t gainsSize = mix->outputs * mix->channels * sizeof(float);
+      gains = (float*)malloc(gainsSize);
+      memcpy(gains, mix->gains, gainsSize);
+
+      buffer = mix->pool->Acquire(samples * mix->frameAlignment);
     }
     virtual ~MixBaton() {
+      for (int i = 0; i < mix->channels; i++) {
+        mix->fifos[i]->Release(samples * mix->alignment);
+      }
+      free(starts);
       free(channelData);
+      free(gains);
+      if (buffer != NULL) mix->pool->Recycle(buffer, samples * mix->frameAlignment);
     }
   };
 
   static void New(const FunctionCallbackInfo<Value>& args);
+  static void CancelQueued(void* arg);
   static void Write(const FunctionCallbackInfo<Value>& args);
-  static void ChannelBuffersGetter(Local<String>, const PropertyCallbackInfo<Value>&);
+  static void Flush(const FunctionCallbackInfo<Value>& args);
+  static void MixSync(const FunctionCallbackInfo<Value>& args);
+  static void IsReady(const FunctionCallbackInfo<Value>& args);
   static void ChannelsReadyGetter(Local<String>, const PropertyCallbackInfo<Value>&);
   static void SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>&);
   static void MixingGetter(Local<String>, const PropertyCallbackInfo<Value>&);
-
-  static void BeginWrite(Baton* baton);
-  static void DoWrite(uv_work_t* req);
-  static void AfterWrite(uv_work_t* req);
-
+  static void SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>&);
+  static void OutputsGetter(Local<String>, const PropertyCallbackInfo<Value>&);
+  static void GainsGetter(Local<String>, const PropertyCallbackInfo<Value>&);
+
+  static void SetGain(const FunctionCallbackInfo<Value>& args);
+  static void SetGains(const FunctionCallbackInfo<Value>& args);
+  bool ParseGains(Isolate* isolate, Local<Value> matrix);
+
+  static void Release(const FunctionCallbackInfo<Value>& args);
+  static void PoolGetter(Local<String>, const PropertyCallbackInfo<Value>&);
+
+  size_t Readable();
+  void Schedule();
+  void End();
+  Local<Object> MixBlock(int samples);
+  void Enqueue(MixBaton* baton);
   static void BeginMix(Baton* baton);
   static void DoMix(uv_work_t* req);
-  static void AfterMix(uv_work_t* req);
+  static void AfterMix(uv_work_t* req, int status);
 
-  Persistent<Array> channelBuffers;
-  Persistent<Array> channelsReady;
   Persistent<Function> callback;
+  BufferPool* pool;
+  Fifo** fifos;
   int channels;
+  int outputs;
+  int frameChannels;
+  int blockSamples;
   int alignment;
+  int frameAlignment;
   int format;
+  float* gains;
+  MixKernel kernel;
+  int typedFormat;
   bool mixing;
+  std::deque<Baton*> queue;
+  int queueSize;
+  bool syncBlocks;
+  bool scheduling;
+  bool flushing;
+  bool ended;
+  Isolate* isolate;
+  uv_loop_t* loop;
 };
 
 }
@@ -0,0 +1,113 @@
+#include "pool.h"
+
+using namespace pcmutils;
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define HOST_FORMAT(le, be) (be)
+#else
+#define HOST_FORMAT(le, be) (le)
+#endif
+
+static Local<Object> TypedView(Local<Object> buffer, size_t length, int format) {
+  Local<ArrayBuffer> data = buffer.As<Uint8Array>()->Buffer();
+  if (format == HOST_FORMAT(FMT_F32LE, FMT_F32BE)) return Float32Array::New(data, 0, length / 4);
+  if (format == HOST_FORMAT(FMT_F64LE, FMT_F64BE)) return Float64Array::New(data, 0, length / 8);
+  if (format == HOST_FORMAT(FMT_S16LE, FMT_S16BE)) return Int16Array::New(data, 0, length / 2);
+  if (format == HOST_FORMAT(FMT_U16LE, FMT_U16BE)) return Uint16Array::New(data, 0, length / 2);
+  if (format == HOST_FORMAT(FMT_S32LE, FMT_S32BE)) return Int32Array::New(data, 0, length / 4);
+  if (format == FMT_U8) return Uint8Array::New(data, 0, length);
+  return buffer;
+}
+
+// 24-bit, foreign byte order and companded samples have no typed array.
+bool pcmutils::HasTypedView(int format) {
+  return format == HOST_FORMAT(FMT_F32LE, FMT_F32BE) || format == HOST_FORMAT(FMT_F64LE, FMT_F64BE) ||
+      format == HOST_FORMAT(FMT_S16LE, FMT_S16BE) || format == HOST_FORMAT(FMT_U16LE, FMT_U16BE) ||
+      format == HOST_FORMAT(FMT_S32LE, FMT_S32BE) || format == FMT_U8;
+}
+
+BufferPool::~BufferPool() {
+  for (size_t i = 0; i < freeSlabs.size(); i++) free(freeSlabs[i]);
+  freeSlabs.clear();
+}
+
+char* BufferPool::Acquire(size_t length) {
+  if (length > slabSize) return (char*)malloc(length);
+
+  char* data;
+  if (freeSlabs.empty()) {
+    data = (char*)malloc(slabSize);
+    slabs++;
+  } else {
+    data = freeSlabs.back();
+    freeSlabs.pop_back();
+  }
+
+  inUse++;
+  if (inUse > highWater) highWater = inUse;
+  return data;
+}
+
+void BufferPool::Recycle(char* data, size_t length) {
+  if (length > slabSize) {
+    free(data);
+    return;
+  }
+
+  inUse--;
+  freeSlabs.push_back(data);
+}
+
+static Local<Private> LeaseKey(Isolate* isolate) {
+  return Private::ForApi(isolate, String::NewFromUtf8(isolate, "pcmutils:lease"));
+}
+
+Local<Object> BufferPool::Wrap(Isolate* isolate, char* data, size_t length, int format) {
+  Lease* lease = new Lease(this, data, length);
+  wrapped++;
+  Local<Object> buffer = Buffer::New(isolate, data, length, FreeCallback, lease).ToLocalChecked();
+  Local<Object> output = format < 0 ? buffer : TypedView(buffer, length, format);
+  output->SetPrivate(isolate->GetCurrentContext(), LeaseKey(isolate), External::New(isolate, lease)).FromJust();
+  return output;
+}
+
+// The lease lives until the memory is collected, and the object carrying
+// it keeps that memory alive, so the pointer is always good here.
+bool BufferPool::Release(Isolate* isolate, Local<Value> value) {
+  if (!value->IsObject()) return false;
+
+  Local<Value> key;
+  if (!value.As<Object>()->GetPrivate(isolate->GetCurrentContext(), LeaseKey(isolate)).ToLocal(&key) || !key->IsExternal()) return false;
+
+  Lease* lease = static_cast<Lease*>(key.As<External>()->Value());
+  if (lease->pool != this || lease->released || lease->length > slabSize) return false;
+
+  lease->released = true;
+  Recycle(lease->data, lease->length);
+  return true;
+}
+
+void BufferPool::FreeCallback(char*, void* hint) {
+  Lease* lease = static_cast<Lease*>(hint);
+  BufferPool* pool = lease->pool;
+
+  if (!lease->released) pool->Recycle(lease->data, lease->length);
+  delete lease;
+
+  pool->wrapped--;
+  if (pool->orphaned && pool->wrapped == 0) delete pool;
+}
+
+Local<Object> BufferPool::Stats(Isolate* isolate) {
+  Local<Object> stats = Object::New(isolate);
+  stats->Set(String::NewFromUtf8(isolate, "slabSize"), Number::New(isolate, slabSize));
+  stats->Set(String::NewFromUtf8(isolate, "slabs"), Number::New(isolate, slabs));
+  stats->Set(String::NewFromUtf8(isolate, "inUse"), Number::New(isolate, inUse));
+  stats->Set(String::NewFromUtf8(isolate, "highWater"), Number::New(isolate, highWater));
+  return stats;
+}
+
+void BufferPool::Destroy() {
+  orphaned = true;
+  if (wrapped == 0) delete this;
+}
\ No newline at end of file
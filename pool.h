@@ -0,0 +1,75 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <cstdlib>
+#include <vector>
+#include <node.h>
+#include <node_buffer.h>
+#include "codecs.h"
+
+using namespace v8;
+using namespace node;
+
+namespace pcmutils {
+
+// Whether typed output is possible for a format, checked up front so a
+// typed stream never falls back to Buffers.
+bool HasTypedView(int format);
+
+// Recycles fixed-size output slabs between blocks. Memory handed to JS
+// through Wrap() comes back to the pool when the consumer calls Release()
+// on the object Wrap() returned, or when it is garbage collected, whichever
+// happens first. Requests larger than a slab are plain malloc'd and only
+// freed once their Buffer is collected.
+//
+// Not thread-safe: acquire, wrap and release on the loop thread only.
+class BufferPool {
+public:
+  BufferPool(size_t slabSize_) : slabSize(slabSize_), slabs(0), inUse(0), highWater(0), wrapped(0), orphaned(false) {
+  }
+
+  char* Acquire(size_t length);
+  void Recycle(char* data, size_t length);
+  // The Buffer takes over acquired memory as-is, so output written there
+  // reaches JS without a copy. With a format, it is viewed as the matching
+  // host-order typed array (Float32Array for F32, Int16Array for S16...)
+  // when there is one. Slabs start on a malloc boundary, so the view is
+  // always aligned.
+  Local<Object> Wrap(Isolate* isolate, char* data, size_t length, int format = -1);
+  // Only the object Wrap() returned, once, can give a slab back early.
+  // Slices, copies and other pools' output are refused.
+  bool Release(Isolate* isolate, Local<Value> value);
+  Local<Object> Stats(Isolate* isolate);
+
+  // Called by the owner when it goes away. The pool deletes itself once
+  // every Buffer it handed out has been released or collected.
+  void Destroy();
+
+  size_t slabSize;
+  size_t slabs;
+  size_t inUse;
+  size_t highWater;
+
+protected:
+  ~BufferPool();
+
+  struct Lease {
+    BufferPool* pool;
+    char* data;
+    size_t length;
+    bool released;
+
+    Lease(BufferPool* pool_, char* data_, size_t length_) : pool(pool_), data(data_), length(length_), released(false) {
+    }
+  };
+
+  static void FreeCallback(char*, void* hint);
+
+  std::vector<char*> freeSlabs;
+  size_t wrapped;
+  bool orphaned;
+};
+
+}
+
+#endif
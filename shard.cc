@@ -0,0 +1,31 @@
+#include "shard.h"
+
+using namespace pcmutils;
+
+ShardSet::ShardSet(int parallel_, int minimum_) : parallel(parallel_), minimum(minimum_), shards(NULL), left(0) {
+  if (parallel > 1) shards = (Shard*)calloc(parallel, sizeof(Shard));
+}
+
+ShardSet::~ShardSet() {
+  free(shards);
+  shards = NULL;
+  left = 0;
+}
+
+bool ShardSet::Queue(uv_loop_t* loop, void* baton, int length, uv_work_cb work, uv_after_work_cb after) {
+  int count = length / minimum;
+  if (count > parallel) count = parallel;
+  if (count < 2) return false;
+
+  int size = length / count;
+  left = count;
+  for (int i = 0; i < count; i++) {
+    Shard* shard = &shards[i];
+    shard->request.data = shard;
+    shard->baton = baton;
+    shard->offset = i * size;
+    shard->length = i == count - 1 ? length - shard->offset : size;
+    QueueWork(loop, &shard->request, work, after);
+  }
+  return true;
+}
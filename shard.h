@@ -0,0 +1,46 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include <cstdlib>
+#include <uv.h>
+#include "worker.h"
+
+namespace pcmutils {
+
+// One slice of a block, run on its own worker and written straight into
+// its place in the block's output. `baton` is whatever was queued.
+struct Shard {
+  uv_work_t request;
+  void* baton;
+  int offset;
+  int length;
+};
+
+// Splits a block by range over up to `parallel` workers, and counts the
+// slices back in. Only touched on the loop thread, one block at a time.
+class ShardSet {
+public:
+  ShardSet(int parallel_, int minimum_);
+  ~ShardSet();
+
+  // Queues `length` units of `baton` as slices of at least `minimum`
+  // units. Returns false, queueing nothing, if that leaves fewer than two.
+  bool Queue(uv_loop_t* loop, void* baton, int length, uv_work_cb work, uv_after_work_cb after);
+
+  // True once the last slice of the block is in. Completions all land on
+  // the loop thread, so whichever comes last finishes the block.
+  bool Join() { return --left == 0; }
+
+  int Index(const Shard* shard) const { return shard - shards; }
+
+  int parallel;
+  int minimum;
+
+protected:
+  Shard* shards;
+  int left;
+};
+
+}
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include "cpu.h"
+
+#ifdef PCM_X86
+
+#include <immintrin.h>
+
+namespace pcmutils {
+
+// Byte order helpers shared by the vectorized kernels. Swaps compile away
+// when not needed, so the same kernel body serves both byte orders.
+
+template <bool Swap>
+PCM_TARGET("sse2")
+static inline __m128i Sse2Swap16(__m128i value) {
+  if (!Swap) return value;
+  return _mm_or_si128(_mm_slli_epi16(value, 8), _mm_srli_epi16(value, 8));
+}
+
+template <bool Swap>
+PCM_TARGET("sse2")
+static inline __m128i Sse2Swap32(__m128i value) {
+  if (!Swap) return value;
+  value = _mm_shufflehi_epi16(_mm_shufflelo_epi16(value, 0xB1), 0xB1);
+  return Sse2Swap16<true>(value);
+}
+
+template <bool BE>
+PCM_TARGET("sse2")
+static inline __m128 Sse2LoadFloat(const char* in) {
+  return _mm_castsi128_ps(Sse2Swap32<BE>(_mm_loadu_si128((const __m128i*)in)));
+}
+
+template <bool BE>
+PCM_TARGET("sse2")
+static inline void Sse2StoreFloat(char* out, __m128 value) {
+  _mm_storeu_si128((__m128i*)out, Sse2Swap32<BE>(_mm_castps_si128(value)));
+}
+
+// AVX2 byte swaps are a single shuffle.
+
+template <bool Swap>
+PCM_TARGET("avx2")
+static inline __m256i Avx2Swap16(__m256i value) {
+  if (!Swap) return value;
+  const __m256i mask = _mm256_setr_epi8(
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+  return _mm256_shuffle_epi8(value, mask);
+}
+
+template <bool Swap>
+PCM_TARGET("avx2")
+static inline __m256i Avx2Swap32(__m256i value) {
+  if (!Swap) return value;
+  const __m256i mask = _mm256_setr_epi8(
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12);
+  return _mm256_shuffle_epi8(value, mask);
+}
+
+template <bool BE>
+PCM_TARGET("avx2")
+static inline __m256 Avx2LoadFloat(const char* in) {
+  return _mm256_castsi256_ps(Avx2Swap32<BE>(_mm256_loadu_si256((const __m256i*)in)));
+}
+
+template <bool BE>
+PCM_TARGET("avx2")
+static inline void Avx2StoreFloat(char* out, __m256 value) {
+  _mm256_storeu_si256((__m256i*)out, Avx2Swap32<BE>(_mm256_castps_si256(value)));
+}
+
+}
+
+#endif
+
+#endif
@@ -9,6 +9,13 @@ void Unzipper::Init(Handle<Object> exports) {
   tpl->SetClassName(String::NewFromUtf8(isolate, "Unzipper"));
 
   NODE_SET_PROTOTYPE_METHOD(tpl, "unzip", Unzip);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "unzipSync", UnzipSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", Release);
+
+  NODE_SET_GETTER(isolate, tpl, "pool", PoolGetter);
+  NODE_SET_GETTER(isolate, tpl, "samplesPerBuffer", SamplesPerBufferGetter);
+  NODE_SET_GETTER(isolate, tpl, "saturated", SaturatedGetter);
+  NODE_SET_GETTER(isolate, tpl, "syncThreshold", SyncThresholdGetter);
 
   // Persistent<Function> constructor = Persistent<Function>::New(isolate, tpl->GetFunction());
   exports->Set(String::NewFromUtf8(isolate, "Unzipper"), tpl->GetFunction());
@@ -23,25 +30,74 @@ void Unzipper::New(const FunctionCallbackInfo<Value>& args) {
   }
 
   REQUIRE_ARGUMENTS(isolate, 2);
+  OPTIONAL_ARGUMENT_OBJECT(isolate, 2, options);
 
   Unzipper* unz = new Unzipper();
   unz->Wrap(args.This());
+  AddQueueOwner(unz, CancelQueued);
+  unz->isolate = isolate;
+  unz->loop = GetCurrentEventLoop(isolate);
 
   unz->channels = args[0]->Int32Value();
+  unz->blockFrames = OPTION_INT(isolate, options, "blockSize", UNZ_BUFFER_FRAMES);
+
+  if (unz->blockFrames < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid block size")));
+    return;
+  }
+
   unz->alignment = args[1]->Int32Value();
+
+  if (unz->channels < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid channel count")));
+    return;
+  }
+
+  if (unz->alignment < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid alignment")));
+    return;
+  }
+
   unz->frameAlignment = unz->channels * unz->alignment;
+  unz->kernel = GetDeinterleaveKernel(unz->channels, unz->alignment);
+  unz->wholeChunk = OPTION_BOOL(isolate, options, "wholeChunk", false);
   unz->unzipping = false;
+  unz->queueSize = OPTION_INT(isolate, options, "queueSize", UNZ_QUEUE_SIZE);
+  if (unz->queueSize < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid queue size")));
+    return;
+  }
+  unz->parallel = OPTION_INT(isolate, options, "parallel", 1);
+  if (unz->parallel < 1) unz->parallel = 1;
+  unz->syncThreshold = OPTION_INT(isolate, options, "syncThreshold", UNZ_SYNC_FRAMES);
 
-  unz->channelBuffers.Reset(isolate, Array::New(isolate, unz->channels));
-  for (int i = 0; i < unz->channels; i++) {
-    size_t blen = unz->alignment * UNZ_BUFFER_FRAMES;
-    MaybeLocal<Object> b = Buffer::New(isolate, blen);
-    unz->channelBuffers.Get(isolate)->Set(i, b.ToLocalChecked());
+  unz->carry = new CarryBuffer(unz->frameAlignment);
+  unz->planar = OPTION_BOOL(isolate, options, "planar", false);
+
+  // Typed output needs the sample format itself, not just its size.
+  if (OPTION_BOOL(isolate, options, "typed", false)) {
+    unz->typedFormat = OPTION_INT(isolate, options, "format", -1);
+    if (!HasTypedView(unz->typedFormat)) {
+      isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "No typed array for this format")));
+      return;
+    }
   }
 
+  // Planar blocks hold every channel, one after the other.
+  int blockBytes = unz->blockFrames * (unz->planar ? unz->frameAlignment : unz->alignment);
+  unz->pool = new BufferPool(OPTION_INT(isolate, options, "slabSize", blockBytes));
+
   args.GetReturnValue().Set(args.This());
 }
 
+void Unzipper::CancelQueued(void* arg) {
+  Unzipper* unz = static_cast<Unzipper*>(arg);
+  while (!unz->queue.empty()) {
+    delete unz->queue.front();
+    unz->queue.pop_front();
+  }
+}
+
 void Unzipper::Unzip(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
 
@@ -50,59 +106,235 @@ void Unzipper::Unzip(const FunctionCallbackInfo<Value>& args) {
 
   Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.Holder());
 
-  COND_ERR_CALL(isolate, unz->unzipping, callback, "Still unzipping");
+  COND_ERR_CALL(isolate, unz->queue.size() >= static_cast<size_t>(unz->queueSize), callback, "Queue full");
 
   UnzipBaton* baton = new UnzipBaton(isolate, unz, callback, args[0]->ToObject());
-  unz->unzipping = true;
-  BeginUnzip(baton);
+  if (unz->unzipping) {
+    unz->queue.push_back(baton);
+  } else {
+    unz->unzipping = true;
+    BeginUnzip(baton);
+  }
+
+  args.GetReturnValue().Set(Boolean::New(isolate, unz->queue.size() < static_cast<size_t>(unz->queueSize)));
+}
+
+// FormatSync's counterpart, for chunks too small to be worth a worker.
+void Unzipper::UnzipSync(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.Holder());
+
+  if (!Buffer::HasInstance(args[0])) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid buffer")));
+    return;
+  }
+
+  if (unz->unzipping) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Unzip in progress")));
+    return;
+  }
+
+  // The same baton a worker gets, so split frames are stitched the same way.
+  UnzipBaton* baton = new UnzipBaton(isolate, unz, Local<Function>(), args[0]->ToObject());
+  baton->passFrames = baton->totalFrames;
+  AcquireBlock(baton);
+  UnzipRange(baton, 0, baton->passFrames, baton->channelData);
+
+  Local<Value> output = WrapBlock(baton);
+  delete baton;
+
+  args.GetReturnValue().Set(output);
+}
+
+void Unzipper::Release(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.Holder());
+  bool released = unz->pool->Release(isolate, args[0]);
+  args.GetReturnValue().Set(Boolean::New(isolate, released));
+}
+
+void Unzipper::PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.This());
+  args.GetReturnValue().Set(unz->pool->Stats(isolate));
+}
+
+void Unzipper::SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, unz->blockFrames));
+}
+
+void Unzipper::SyncThresholdGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, unz->syncThreshold));
+}
+
+void Unzipper::SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Unzipper* unz = ObjectWrap::Unwrap<Unzipper>(args.This());
+  args.GetReturnValue().Set(Boolean::New(isolate, unz->queue.size() >= static_cast<size_t>(unz->queueSize)));
 }
 
 void Unzipper::BeginUnzip(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoUnzip, (uv_after_work_cb)AfterUnzip);
+  UnzipBaton* unzBaton = static_cast<UnzipBaton*>(baton);
+  Unzipper* unz = baton->unz;
+
+  if (unzBaton->totalFrames == 0) {
+    HandleScope scope(unz->isolate);
+    FinishUnzip(unzBaton, Null(unz->isolate));
+    return;
+  }
+
+  unzBaton->passFrames = unzBaton->totalFrames - unzBaton->unzippedFrames;
+  if (unzBaton->blockFrames < unzBaton->passFrames) unzBaton->passFrames = unzBaton->blockFrames;
+
+  AcquireBlock(unzBaton);
+
+  // Large blocks are split by frame range over up to `parallel` workers.
+  if (!unzBaton->shards.Queue(unz->loop, unzBaton, unzBaton->passFrames, DoUnzipShard, AfterUnzipShard)) {
+    QueueWork(unz->loop, &baton->request, DoUnzip, AfterUnzip);
+  }
+}
+
+// In planar mode the output is a single block with the channels back to back.
+void Unzipper::AcquireBlock(UnzipBaton* baton) {
+  Unzipper* unz = baton->unz;
+
+  if (unz->planar) {
+    char* planes = unz->pool->Acquire(baton->passFrames * unz->frameAlignment);
+    for (int channel = 0; channel < unz->channels; channel++) {
+      baton->channelData[channel] = planes + channel * baton->passFrames * unz->alignment;
+    }
+  } else {
+    for (int channel = 0; channel < unz->channels; channel++) {
+      baton->channelData[channel] = unz->pool->Acquire(baton->passFrames * unz->alignment);
+    }
+  }
 }
 
 void Unzipper::DoUnzip(uv_work_t* req) {
   UnzipBaton* baton = static_cast<UnzipBaton*>(req->data);
+  UnzipRange(baton, baton->unzippedFrames, baton->passFrames, baton->channelData);
+}
+
+void Unzipper::UnzipRange(UnzipBaton* baton, int start, int frames, char** out) {
   Unzipper* unz = baton->unz;
 
-  int sample = 0;
-  int limitFrames = baton->unzippedFrames + UNZ_BUFFER_FRAMES;
-  for (; baton->unzippedFrames < limitFrames && baton->unzippedFrames < baton->totalFrames; baton->unzippedFrames++) {
+  // The stitched frame, if any, comes before the rest of the chunk. The
+  // output pointers are stepped past it for the kernel and put back after.
+  int stepped = 0;
+  if (start < baton->headFrames && frames > 0) {
     for (int channel = 0; channel < unz->channels; channel++) {
-      memcpy(
-        baton->channelData[channel] + (sample * unz->alignment),
-        baton->chunkData + (baton->unzippedFrames * unz->frameAlignment) + (channel * unz->alignment),
-        unz->alignment
-      );
+      memcpy(out[channel], baton->head + channel * unz->alignment, unz->alignment);
+      out[channel] += unz->alignment;
     }
-    sample++;
+    stepped = 1;
+    start++;
+    frames--;
+  }
+
+  const char* in = baton->chunkData + (start - baton->headFrames) * unz->frameAlignment;
+  unz->kernel(in, out, frames, unz->channels, unz->alignment);
+
+  if (stepped) {
+    for (int channel = 0; channel < unz->channels; channel++) out[channel] -= unz->alignment;
   }
 }
 
-void Unzipper::AfterUnzip(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
-  UnzipBaton* baton = static_cast<UnzipBaton*>(req->data);
+void Unzipper::DoUnzipShard(uv_work_t* req) {
+  Shard* shard = static_cast<Shard*>(req->data);
+  UnzipBaton* baton = static_cast<UnzipBaton*>(shard->baton);
   Unzipper* unz = baton->unz;
 
-  // Copy buffers because we may clobber them soon.
-  Local<Array> channelBuffersCopy = Local<Array>::New(isolate, Array::New(isolate, unz->channels));
+  char** out = baton->shardData + baton->shards.Index(shard) * unz->channels;
+  for (int channel = 0; channel < unz->channels; channel++) {
+    out[channel] = baton->channelData[channel] + shard->offset * unz->alignment;
+  }
+  UnzipRange(baton, baton->unzippedFrames + shard->offset, shard->length, out);
+}
+
+void Unzipper::AfterUnzipShard(uv_work_t* req, int status) {
+  Shard* shard = static_cast<Shard*>(req->data);
+  UnzipBaton* baton = static_cast<UnzipBaton*>(shard->baton);
+
+  if (!baton->shards.Join()) return;
+  AfterUnzip(&baton->request, status);
+}
+
+// Planar blocks go out as one Buffer, others as one per channel.
+Local<Value> Unzipper::WrapBlock(UnzipBaton* baton) {
+  Unzipper* unz = baton->unz;
+  Isolate *isolate = unz->isolate;
+
+  if (unz->planar) {
+    Local<Object> planes = unz->pool->Wrap(isolate, baton->channelData[0], unz->frameAlignment * baton->passFrames, unz->typedFormat);
+    for (int i = 0; i < unz->channels; i++) baton->channelData[i] = NULL;
+    return planes;
+  }
+
+  Local<Array> channelBuffers = Local<Array>::New(isolate, Array::New(isolate, unz->channels));
   for (int i = 0; i < unz->channels; i++) {
-    // Yes, copy is ok
-    size_t blen = unz->alignment * UNZ_BUFFER_FRAMES;
-    MaybeLocal<Object> b = Buffer::New(isolate, Buffer::Data(unz->channelBuffers.Get(isolate)->Get(i)->ToObject()), blen);
-    channelBuffersCopy->Set(i, b.ToLocalChecked());
+    size_t blen = unz->alignment * baton->passFrames;
+    Local<Object> b = unz->pool->Wrap(isolate, baton->channelData[i], blen, unz->typedFormat);
+    baton->channelData[i] = NULL;
+    channelBuffers->Set(i, b);
+  }
+  return channelBuffers;
+}
+
+void Unzipper::AfterUnzip(uv_work_t* req, int status) {
+  UnzipBaton* baton = static_cast<UnzipBaton*>(req->data);
+
+  if (status == UV_ECANCELED) {
+    delete baton;
+    return;
   }
 
+  Unzipper* unz = baton->unz;
+  Isolate *isolate = unz->isolate;
+  HandleScope scope(isolate);
+
+  baton->unzippedFrames += baton->passFrames;
+
+  Local<Value> output = WrapBlock(baton);
+
   if (baton->unzippedFrames < baton->totalFrames) {
-    Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, channelBuffersCopy), Local<Value>::New(isolate, Boolean::New(isolate, false)) };
-    TRY_CATCH_CALL(isolate, unz->handle(), baton->callback, 3, argv);
     BeginUnzip(baton);
+    Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), output, Local<Value>::New(isolate, Boolean::New(isolate, false)) };
+    TRY_CATCH_CALL(isolate, unz->handle(), baton->callback, 3, argv);
     return;
   }
 
-  unz->unzipping = false;
-  Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, channelBuffersCopy), Local<Value>::New(isolate, Boolean::New(isolate, true)) };
+  FinishUnzip(baton, output);
+}
+
+void Unzipper::FinishUnzip(UnzipBaton* baton, Local<Value> output) {
+  Unzipper* unz = baton->unz;
+  Isolate *isolate = unz->isolate;
+
+  Baton* next = NULL;
+  if (unz->queue.empty()) {
+    unz->unzipping = false;
+  } else {
+    next = unz->queue.front();
+    unz->queue.pop_front();
+    if (static_cast<UnzipBaton*>(next)->totalFrames > 0) {
+      BeginUnzip(next);
+      next = NULL;
+    }
+  }
+
+  Local<Value> argv[3] = { Local<Value>::New(isolate, Null(isolate)), output, Local<Value>::New(isolate, Boolean::New(isolate, true)) };
   TRY_CATCH_CALL(isolate, unz->handle(), baton->callback, 3, argv);
   delete baton;
+
+  if (next != NULL) BeginUnzip(next);
 }
\ No newline at end of file
@@ -3,13 +3,22 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <uv.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_object_wrap.h>
 #include "macros.h"
+#include "pool.h"
+#include "worker.h"
+#include "interleave.h"
+#include "carry.h"
+#include "shard.h"
 
 #define UNZ_BUFFER_FRAMES 1024
+#define UNZ_QUEUE_SIZE 4
+#define UNZ_SHARD_FRAMES 16384
+#define UNZ_SYNC_FRAMES 256
 
 using namespace v8;
 using namespace node;
@@ -23,16 +32,27 @@ public:
   static void Init(Handle<Object> exports);
 
 protected:
-  Unzipper() : ObjectWrap(), channels(0), alignment(0), frameAlignment(0), unzipping(false) {
-    channelBuffers.Reset();
+  Unzipper() : ObjectWrap(), channels(0), blockFrames(0), alignment(0), frameAlignment(0), wholeChunk(false), planar(false), typedFormat(-1), unzipping(false), queueSize(0), parallel(0), syncThreshold(0), pool(NULL), carry(NULL), kernel(NULL), isolate(NULL), loop(NULL) {
   }
 
   ~Unzipper() {
+    RemoveQueueOwner(this);
     channels = 0;
+    blockFrames = 0;
     alignment = 0;
     frameAlignment = 0;
+    wholeChunk = false;
+    planar = false;
+    typedFormat = -1;
     unzipping = false;
-    channelBuffers.Reset();
+    queueSize = 0;
+    parallel = 0;
+    syncThreshold = 0;
+    if (pool != NULL) pool->Destroy();
+    pool = NULL;
+    if (carry != NULL) delete carry;
+    carry = NULL;
+    kernel = NULL;
   }
 
   struct Baton {
@@ -53,12 +73,19 @@ protected:
     Persistent<Object> chunk;
     size_t chunkLength;
     char* chunkData;
+    char* head;
     char** channelData;
+    int headFrames;
+    int blockFrames;
     int totalFrames;
     int unzippedFrames;
+    int passFrames;
+    ShardSet shards;
+    char** shardData;
 
     UnzipBaton(Isolate* isolate, Unzipper* unz_, Handle<Function> cb_, Handle<Object> chunk_) : Baton(unz_),
-        chunkLength(0), chunkData(NULL), channelData(NULL), totalFrames(0), unzippedFrames(0) {
+        chunkLength(0), chunkData(NULL), head(NULL), channelData(NULL), headFrames(0), blockFrames(0), totalFrames(0), unzippedFrames(0), passFrames(0),
+        shards(unz_->parallel, UNZ_SHARD_FRAMES), shardData(NULL) {
 
       callback.Reset(isolate, cb_);
 
@@ -66,36 +93,76 @@ protected:
       chunkData = Buffer::Data(chunk.Get(isolate));
       chunkLength = Buffer::Length(chunk.Get(isolate));
 
-      channelData = (char**)malloc(unz->channels * sizeof(char*));
-      for (int i = 0; i < unz->channels; i++) {
-        channelData[i] = Buffer::Data(unz->channelBuffers.Get(isolate)->Get(i)->ToObject());
-      }
-
-      totalFrames = chunkLength / unz->frameAlignment;
-
-      // Todo - check for and handle alignment issues
-      // int leftoverBytes = chunkLength % unz->frameAlignment;
-      // if (leftoverBytes != 0) fprintf(stderr, "LEFTOVRES: %d\n", leftoverBytes);
+      // A frame split across chunks is completed from this one and
+      // unzipped first, and this chunk's own partial frame waits for the
+      // next. Batons are built in submission order, so this is too.
+      size_t skip, bodyFrames;
+      head = (char*)malloc(unz->frameAlignment);
+      headFrames = unz->carry->Split(chunkData, chunkLength, head, &skip, &bodyFrames) ? 1 : 0;
+      chunkData += skip;
+      totalFrames = headFrames + bodyFrames;
+
+      // In whole chunk mode the chunk is unzipped in a single pass.
+      blockFrames = unz->wholeChunk ? totalFrames : unz->blockFrames;
+      channelData = (char**)calloc(unz->channels, sizeof(char*));
+
+      // Each slice gets its own set of output pointers.
+      if (unz->parallel > 1) shardData = (char**)calloc(unz->parallel * unz->channels, sizeof(char*));
     }
     virtual ~UnzipBaton() {
       callback.Reset();
       chunk.Reset();
+      if (unz->planar) {
+        if (channelData[0] != NULL) unz->pool->Recycle(channelData[0], passFrames * unz->frameAlignment);
+      } else {
+        for (int i = 0; i < unz->channels; i++) {
+          if (channelData[i] != NULL) unz->pool->Recycle(channelData[i], passFrames * unz->alignment);
+        }
+      }
       free(channelData);
+      free(shardData);
+      free(head);
     }
   };
 
   static void New(const FunctionCallbackInfo<Value>& args);
+  static void CancelQueued(void* arg);
   static void Unzip(const FunctionCallbackInfo<Value>& args);
+  static void UnzipSync(const FunctionCallbackInfo<Value>& args);
+
+  static void Release(const FunctionCallbackInfo<Value>& args);
+  static void PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SyncThresholdGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
 
   static void BeginUnzip(Baton* baton);
+  static void AcquireBlock(UnzipBaton* baton);
+  static Local<Value> WrapBlock(UnzipBaton* baton);
+  static void UnzipRange(UnzipBaton* baton, int start, int frames, char** out);
   static void DoUnzip(uv_work_t* req);
-  static void AfterUnzip(uv_work_t* req);
+  static void AfterUnzip(uv_work_t* req, int status);
+  static void FinishUnzip(UnzipBaton* baton, Local<Value> output);
+  static void DoUnzipShard(uv_work_t* req);
+  static void AfterUnzipShard(uv_work_t* req, int status);
 
-  Persistent<Array> channelBuffers;
   int channels;
+  int blockFrames;
   int alignment;
   int frameAlignment;
+  bool wholeChunk;
+  bool planar;
+  int typedFormat;
   bool unzipping;
+  std::deque<Baton*> queue;
+  int queueSize;
+  int parallel;
+  int syncThreshold;
+  BufferPool* pool;
+  CarryBuffer* carry;
+  DeinterleaveKernel kernel;
+  Isolate* isolate;
+  uv_loop_t* loop;
 };
 
 }
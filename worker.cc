@@ -0,0 +1,244 @@
+#include <map>
+#include <thread>
+#include "worker.h"
+
+using namespace pcmutils;
+
+WorkQueue::WorkQueue(size_t capacity) : mask(capacity - 1), pushPos(0), popPos(0) {
+  cells = new Cell[capacity];
+  for (size_t i = 0; i < capacity; i++) {
+    cells[i].sequence.store(i, std::memory_order_relaxed);
+    cells[i].data = NULL;
+  }
+}
+
+WorkQueue::~WorkQueue() {
+  delete[] cells;
+}
+
+bool WorkQueue::Push(void* data) {
+  Cell* cell;
+  size_t pos = pushPos.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)pos;
+    if (diff == 0) {
+      if (pushPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = pushPos.load(std::memory_order_relaxed);
+    }
+  }
+
+  cell->data = data;
+  cell->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+bool WorkQueue::Pop(void** data) {
+  Cell* cell;
+  size_t pos = popPos.load(std::memory_order_relaxed);
+  for (;;) {
+    cell = &cells[pos & mask];
+    size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    intptr_t diff = (intptr_t)sequence - (intptr_t)(pos + 1);
+    if (diff == 0) {
+      if (popPos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+    } else if (diff < 0) {
+      return false;
+    } else {
+      pos = popPos.load(std::memory_order_relaxed);
+    }
+  }
+
+  *data = cell->data;
+  cell->sequence.store(pos + mask + 1, std::memory_order_release);
+  return true;
+}
+
+thread_local WorkerPool* WorkerPool::instance = NULL;
+
+static thread_local std::map<void*, void (*)(void*)> queueOwners;
+
+static void CancelQueued(void*) {
+  while (!queueOwners.empty()) {
+    std::map<void*, void (*)(void*)>::iterator it = queueOwners.begin();
+    void* owner = it->first;
+    void (*cancel)(void*) = it->second;
+    queueOwners.erase(it);
+    cancel(owner);
+  }
+}
+
+void pcmutils::AddQueueOwner(void* owner, void (*cancel)(void* owner)) {
+  queueOwners[owner] = cancel;
+}
+
+void pcmutils::RemoveQueueOwner(void* owner) {
+  queueOwners.erase(owner);
+}
+
+void WorkerPool::Init(Handle<Object> exports) {
+  NODE_SET_METHOD(exports, "workerPool", SetSize);
+  AddEnvironmentCleanupHook(exports->GetIsolate(), CancelQueued, NULL);
+}
+
+WorkerPool::WorkerPool(uv_loop_t* loop, int size_) : size(size_), pending(WORKER_QUEUE_SIZE), done(WORKER_QUEUE_SIZE),
+    threads(NULL), inFlight(0), stopping(false) {
+  uv_sem_init(&ready, 0);
+
+  // Only keeps the loop alive while there is work in flight, like a request.
+  uv_async_init(loop, &async, Complete);
+  async.data = this;
+  uv_unref((uv_handle_t*)&async);
+
+  threads = (uv_thread_t*)malloc(size * sizeof(uv_thread_t));
+  for (int i = 0; i < size; i++) {
+    uv_thread_create(&threads[i], Run, this);
+  }
+}
+
+WorkerPool::~WorkerPool() {
+  free(threads);
+  threads = NULL;
+  uv_sem_destroy(&ready);
+}
+
+// Resizes the pool, 0 hands work back to the libuv threadpool. Only
+// allowed while nothing is in flight.
+void WorkerPool::SetSize(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  int size = args[0]->Int32Value();
+  if (size < 0) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid pool size")));
+    return;
+  }
+
+  int current = instance != NULL ? instance->size : 0;
+  if (size != current) {
+    if (instance != NULL && instance->inFlight > 0) {
+      isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Worker pool is busy")));
+      return;
+    }
+
+    if (instance != NULL) {
+      RemoveEnvironmentCleanupHook(isolate, Cleanup, instance);
+      instance->Stop();
+      instance = NULL;
+    }
+
+    // Threads are joined when the environment goes away, so a worker_thread
+    // that exits doesn't leave its pool behind.
+    if (size > 0) {
+      instance = new WorkerPool(GetCurrentEventLoop(isolate), size);
+      AddEnvironmentCleanupHook(isolate, Cleanup, instance);
+    }
+  }
+
+  args.GetReturnValue().Set(Integer::New(isolate, size));
+}
+
+void WorkerPool::Queue(uv_work_t* req, uv_work_cb work, uv_after_work_cb after) {
+  req->loop = async.loop;
+  req->work_cb = work;
+  req->after_work_cb = after;
+
+  // Every request fits in the completion queue as long as this holds.
+  if (inFlight >= WORKER_QUEUE_SIZE) {
+    waiting.push_back(req);
+    return;
+  }
+
+  pending.Push(req);
+  if (inFlight++ == 0) uv_ref((uv_handle_t*)&async);
+  uv_sem_post(&ready);
+}
+
+void WorkerPool::Run(void* arg) {
+  WorkerPool* pool = static_cast<WorkerPool*>(arg);
+
+  for (;;) {
+    // One post per request, plus one per thread when stopping.
+    uv_sem_wait(&pool->ready);
+    if (pool->stopping) return;
+
+    // Each post follows a push, but the push may not be visible yet. The
+    // request is there, so wait for it rather than dropping the wakeup.
+    void* data;
+    while (!pool->pending.Pop(&data)) std::this_thread::yield();
+
+    uv_work_t* req = static_cast<uv_work_t*>(data);
+    req->work_cb(req);
+    pool->done.Push(req);
+    uv_async_send(&pool->async);
+  }
+}
+
+void WorkerPool::Complete(uv_async_t* handle) {
+  WorkerPool* pool = static_cast<WorkerPool*>(handle->data);
+
+  // Sends coalesce, so drain everything that finished since the last one.
+  void* data;
+  while (pool->done.Pop(&data)) {
+    uv_work_t* req = static_cast<uv_work_t*>(data);
+    if (--pool->inFlight == 0) uv_unref((uv_handle_t*)&pool->async);
+    req->after_work_cb(req, 0);
+  }
+
+  while (!pool->waiting.empty() && pool->inFlight < WORKER_QUEUE_SIZE) {
+    uv_work_t* req = pool->waiting.front();
+    pool->waiting.pop_front();
+    pool->Queue(req, req->work_cb, req->after_work_cb);
+  }
+}
+
+void WorkerPool::Stop() {
+  stopping = true;
+  for (int i = 0; i < size; i++) uv_sem_post(&ready);
+  for (int i = 0; i < size; i++) uv_thread_join(&threads[i]);
+  uv_close((uv_handle_t*)&async, Closed);
+}
+
+// With the threads joined, hands back everything that never got its after
+// callback, whether it ran or not, so the batons are freed.
+void WorkerPool::Cancel() {
+  void* data;
+  while (done.Pop(&data) || pending.Pop(&data)) {
+    uv_work_t* req = static_cast<uv_work_t*>(data);
+    inFlight--;
+    req->after_work_cb(req, UV_ECANCELED);
+  }
+
+  while (!waiting.empty()) {
+    uv_work_t* req = waiting.front();
+    waiting.pop_front();
+    req->after_work_cb(req, UV_ECANCELED);
+  }
+}
+
+void WorkerPool::Closed(uv_handle_t* handle) {
+  delete static_cast<WorkerPool*>(handle->data);
+}
+
+void WorkerPool::Cleanup(void* arg) {
+  WorkerPool* pool = static_cast<WorkerPool*>(arg);
+  if (instance == pool) instance = NULL;
+
+  // Node turns the loop once more after its cleanup hooks, which runs the
+  // close callback that frees the pool.
+  pool->Stop();
+  pool->Cancel();
+}
+
+void pcmutils::QueueWork(uv_loop_t* loop, uv_work_t* req, uv_work_cb work, uv_after_work_cb after) {
+  if (WorkerPool::instance != NULL) {
+    WorkerPool::instance->Queue(req, work, after);
+    return;
+  }
+  uv_queue_work(loop, req, work, after);
+}
@@ -0,0 +1,98 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <atomic>
+#include <cstdlib>
+#include <deque>
+#include <uv.h>
+#include <node.h>
+#include "macros.h"
+
+#define WORKER_QUEUE_SIZE 1024
+
+using namespace v8;
+using namespace node;
+
+namespace pcmutils {
+
+// Bounded multi-producer multi-consumer queue of pointers. Each slot
+// carries a sequence number telling producers and consumers whose turn it
+// is, so neither side ever takes a lock. Capacity must be a power of two.
+class WorkQueue {
+public:
+  WorkQueue(size_t capacity);
+  ~WorkQueue();
+
+  bool Push(void* data);
+  bool Pop(void** data);
+
+protected:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    void* data;
+  };
+
+  Cell* cells;
+  size_t mask;
+  std::atomic<size_t> pushPos;
+  std::atomic<size_t> popPos;
+};
+
+// Threads reserved for audio work, so a burst of fs, dns or zlib requests
+// on the libuv threadpool can't hold up a block. Requests go in through a
+// lock-free queue, and come back to the loop through a uv_async_t that runs
+// their after callbacks just like uv_queue_work would. Requests beyond what
+// the queues hold wait on the loop thread rather than going to libuv, so
+// the pool owns all of them. Those still in flight when the environment
+// goes away get UV_ECANCELED, and must only free their resources then.
+class WorkerPool {
+public:
+  static void Init(Handle<Object> exports);
+
+  // The running pool, or NULL when work goes to the libuv threadpool.
+  // Each environment (main thread or worker_thread) has its own.
+  static thread_local WorkerPool* instance;
+
+  void Queue(uv_work_t* req, uv_work_cb work, uv_after_work_cb after);
+
+  int size;
+
+protected:
+  WorkerPool(uv_loop_t* loop, int size_);
+  ~WorkerPool();
+
+  static void SetSize(const FunctionCallbackInfo<Value>& args);
+  static void Run(void* arg);
+  static void Complete(uv_async_t* handle);
+  static void Closed(uv_handle_t* handle);
+  static void Cleanup(void* arg);
+
+  void Stop();
+  void Cancel();
+
+  WorkQueue pending;
+  WorkQueue done;
+  std::deque<uv_work_t*> waiting;
+  uv_sem_t ready;
+  uv_async_t async;
+  uv_thread_t* threads;
+  size_t inFlight;
+  std::atomic<bool> stopping;
+};
+
+// Instances run one chunk or block at a time, and keep the ones submitted
+// meanwhile in queues of their own, in order. Whatever is still there when
+// the environment goes away is never started, and is handed to `cancel` to
+// free.
+void AddQueueOwner(void* owner, void (*cancel)(void* owner));
+void RemoveQueueOwner(void* owner);
+
+// Runs work off the loop thread and after back on it, through the worker
+// pool when one is running and the libuv threadpool otherwise. Callers
+// queue their next block, or next chunk, before delivering the one just
+// done, so the worker keeps going while JS handles the output.
+void QueueWork(uv_loop_t* loop, uv_work_t* req, uv_work_cb work, uv_after_work_cb after);
+
+}
+
+#endif
@@ -9,11 +9,16 @@ void Zipper::Init(Handle<Object> exports) {
   tpl->SetClassName(String::NewFromUtf8(isolate, "Zipper"));
 
   NODE_SET_PROTOTYPE_METHOD(tpl, "write", Write);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "flush", Flush);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "zipSync", ZipSync);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "isReady", IsReady);
+  NODE_SET_PROTOTYPE_METHOD(tpl, "release", Release);
 
-  NODE_SET_GETTER(isolate, tpl, "channelBuffers", ChannelBuffersGetter);
   NODE_SET_GETTER(isolate, tpl, "channelsReady", ChannelsReadyGetter);
   NODE_SET_GETTER(isolate, tpl, "samplesPerBuffer", SamplesPerBufferGetter);
+  NODE_SET_GETTER(isolate, tpl, "pool", PoolGetter);
   NODE_SET_GETTER(isolate, tpl, "zipping", ZippingGetter);
+  NODE_SET_GETTER(isolate, tpl, "saturated", SaturatedGetter);
 
   // Persistent<Function> constructor = Persistent<Function>::New(tpl->GetFunction());
   exports->Set(String::NewFromUtf8(isolate, "Zipper"), tpl->GetFunction());
@@ -29,41 +34,90 @@ void Zipper::New(const FunctionCallbackInfo<Value>& args) {
 
   REQUIRE_ARGUMENTS(isolate, 3);
   REQUIRE_ARGUMENT_FUNCTION(isolate, 2, callback);
+  OPTIONAL_ARGUMENT_OBJECT(isolate, 3, options);
 
   Zipper* zip = new Zipper();
   zip->Wrap(args.This());
+  AddQueueOwner(zip, CancelQueued);
+  zip->isolate = isolate;
+  zip->loop = GetCurrentEventLoop(isolate);
 
   zip->channels = args[0]->Int32Value();
+  zip->blockSamples = OPTION_INT(isolate, options, "blockSize", ZIP_BUFFER_SAMPLES);
+
+  if (zip->blockSamples < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid block size")));
+    return;
+  }
+
   zip->alignment = args[1]->Int32Value();
+
+  if (zip->channels < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid channel count")));
+    return;
+  }
+
+  if (zip->alignment < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid alignment")));
+    return;
+  }
+
   zip->frameAlignment = zip->alignment * zip->channels;
+  zip->kernel = GetInterleaveKernel(zip->channels, zip->alignment);
+
+  // Only the alignment is needed to zip, typed output also needs to know
+  // what the samples are.
+  if (OPTION_BOOL(isolate, options, "typed", false)) {
+    zip->typedFormat = OPTION_INT(isolate, options, "format", -1);
+    if (!HasTypedView(zip->typedFormat)) {
+      isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "No typed array for this format")));
+      return;
+    }
+  }
   zip->callback.Reset(isolate, callback);
   zip->zipping = false;
+  zip->queueSize = OPTION_INT(isolate, options, "queueSize", ZIP_QUEUE_SIZE);
+  if (zip->queueSize < 1) {
+    isolate->ThrowException(Exception::TypeError(String::NewFromUtf8(isolate, "Invalid queue size")));
+    return;
+  }
 
-  zip->channelBuffers.Reset(isolate, Array::New(isolate, zip->channels));
+  zip->syncBlocks = zip->blockSamples <= OPTION_INT(isolate, options, "syncThreshold", ZIP_SYNC_SAMPLES);
 
-  zip->channelsReady.Reset(isolate, Array::New(isolate, zip->channels));
+  int fifoBlocks = OPTION_INT(isolate, options, "fifoSize", ZIP_FIFO_BLOCKS);
+  if (fifoBlocks < 1) fifoBlocks = 1;
+  zip->fifos = (Fifo**)malloc(zip->channels * sizeof(Fifo*));
   for (int i = 0; i < zip->channels; i++) {
-    zip->channelsReady.Get(isolate)->Set(i, Boolean::New(isolate, false));
+    zip->fifos[i] = new Fifo(fifoBlocks * zip->blockSamples * zip->alignment);
   }
 
-  zip->buffer = (char*)malloc(ZIP_BUFFER_SAMPLES * zip->frameAlignment);
+  zip->pool = new BufferPool(OPTION_INT(isolate, options, "slabSize", zip->blockSamples * zip->frameAlignment));
 
   args.GetReturnValue().Set(args.This());
 }
 
-void Zipper::ChannelBuffersGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
-  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.This());
-  args.GetReturnValue().Set(zip->channelBuffers);
+void Zipper::CancelQueued(void* arg) {
+  Zipper* zip = static_cast<Zipper*>(arg);
+  while (!zip->queue.empty()) {
+    delete zip->queue.front();
+    zip->queue.pop_front();
+  }
 }
 
 void Zipper::ChannelsReadyGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
   Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.This());
-  args.GetReturnValue().Set(zip->channelsReady);
+  Local<Array> ready = Array::New(isolate, zip->channels);
+  for (int i = 0; i < zip->channels; i++) {
+    ready->Set(i, Boolean::New(isolate, zip->fifos[i]->Readable() >= static_cast<size_t>(zip->blockSamples * zip->alignment)));
+  }
+  args.GetReturnValue().Set(ready);
 }
 
 void Zipper::SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
-  args.GetReturnValue().Set(Integer::New(isolate, ZIP_BUFFER_SAMPLES));
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.This());
+  args.GetReturnValue().Set(Integer::New(isolate, zip->blockSamples));
 }
 
 void Zipper::ZippingGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
@@ -72,6 +126,18 @@ void Zipper::ZippingGetter(Local<String>, const PropertyCallbackInfo<Value>& arg
   args.GetReturnValue().Set(Boolean::New(isolate, zip->zipping));
 }
 
+void Zipper::SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.This());
+  args.GetReturnValue().Set(Boolean::New(isolate, zip->queue.size() >= static_cast<size_t>(zip->queueSize)));
+}
+
+void Zipper::PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.This());
+  args.GetReturnValue().Set(zip->pool->Stats(isolate));
+}
+
 void Zipper::Write(const FunctionCallbackInfo<Value>& args) {
   Isolate *isolate = args.GetIsolate();
 
@@ -80,93 +146,197 @@ void Zipper::Write(const FunctionCallbackInfo<Value>& args) {
 
   Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.Holder());
 
-  COND_ERR_CALL(isolate, zip->zipping, callback, "Still zipping");
   int channel = args[0]->Int32Value();
-  COND_ERR_CALL(isolate, zip->channelsReady.Get(isolate)->Get(channel)->BooleanValue(), callback, "Already Ready");
+  COND_ERR_CALL(isolate, channel < 0 || channel >= zip->channels, callback, "Invalid channel");
+  COND_ERR_CALL(isolate, !Buffer::HasInstance(args[1]), callback, "Invalid buffer");
 
-  zip->channelBuffers.Get(isolate)->Set(channel, args[1]->ToObject());
-  zip->channelsReady.Get(isolate)->Set(channel, Boolean::New(isolate, true));
+  size_t written = zip->fifos[channel]->Write(Buffer::Data(args[1]), Buffer::Length(args[1]));
 
-  WriteBaton* baton = new WriteBaton(isolate, zip, callback, channel);
-  BeginWrite(baton);
-}
+  if (!callback.IsEmpty()) {
+    Local<Value> argv[1] = { v8::Local<v8::Value>() };
+    TRY_CATCH_CALL(isolate, zip->handle(), callback, 0, argv);
+  }
 
-void Zipper::BeginWrite(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoWrite, (uv_after_work_cb)AfterWrite);
+  zip->Schedule();
+  zip->End();
+
+  args.GetReturnValue().Set(Integer::New(isolate, written));
 }
 
-void Zipper::DoWrite(uv_work_t* req) {
-  // Just a hop thru the evq
+// Zips what is left once the inputs have ended, down to the last whole
+// sample every channel has.
+void Zipper::Flush(const FunctionCallbackInfo<Value>& args) {
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.Holder());
+  zip->flushing = true;
+  zip->Schedule();
+  zip->End();
 }
 
-void Zipper::AfterWrite(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
-  WriteBaton* baton = static_cast<WriteBaton*>(req->data);
-  Zipper* zip = baton->zip;
+// Like the Mixer's mixSync, a block now or null if it can't be zipped yet.
+void Zipper::ZipSync(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.Holder());
 
-  if (!baton->callback.IsEmpty()) {
-    Local<Value> argv[1] = { v8::Local<v8::Value>() };
-    TRY_CATCH_CALL(isolate, zip->handle(), baton->callback, 0, argv);
+  if (zip->zipping || zip->Readable() < static_cast<size_t>(zip->blockSamples * zip->alignment)) {
+    args.GetReturnValue().Set(Null(isolate));
+    return;
   }
 
-  if (!zip->zipping) {
-    bool ready = true;
-    for (int i = 0; i < zip->channels; i++) {
-      if (!zip->channelsReady.Get(isolate)->Get(i)->BooleanValue()) ready = false;
+  args.GetReturnValue().Set(zip->ZipBlock(zip->blockSamples));
+}
+
+// Least any channel has buffered, only that much can be zipped.
+size_t Zipper::Readable() {
+  size_t readable = fifos[0]->Readable();
+  for (int i = 1; i < channels; i++) {
+    if (fifos[i]->Readable() < readable) readable = fifos[i]->Readable();
+  }
+  return readable;
+}
+
+void Zipper::Schedule() {
+  if (scheduling) return;
+  scheduling = true;
+
+  size_t blockBytes = blockSamples * alignment;
+
+  for (;;) {
+    size_t readable = Readable();
+
+    int samples = blockSamples;
+    if (readable < blockBytes) {
+      if (!flushing) break;
+      samples = readable / alignment;
+      if (samples == 0) break;
+    } else if (!flushing && zipping && queue.size() >= static_cast<size_t>(queueSize)) {
+      break;
+    }
+
+    if (!syncBlocks) {
+      Enqueue(new ZipBaton(this, samples));
+      continue;
     }
 
-    if (ready) {
-      ZipBaton* zipBaton = new ZipBaton(isolate, zip);
-      zip->zipping = true;
-      BeginZip(zipBaton);
+    HandleScope scope(isolate);
+    Local<Object> buffer = ZipBlock(samples);
+    if (!callback.IsEmpty()) {
+      Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer) };
+      TRY_CATCH_CALL(isolate, handle(), callback, 2, argv);
     }
   }
 
+  scheduling = false;
+}
+
+void Zipper::End() {
+  if (!flushing || ended || scheduling || zipping || !queue.empty()) return;
+  ended = true;
+
+  HandleScope scope(isolate);
+  if (!callback.IsEmpty()) {
+    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, Null(isolate)) };
+    TRY_CATCH_CALL(isolate, handle(), callback, 2, argv);
+  }
+}
+
+// Zips a block on the calling thread, with the same baton a worker uses.
+Local<Object> Zipper::ZipBlock(int samples) {
+  ZipBaton* baton = new ZipBaton(this, samples);
+  DoZip(&baton->request);
+
+  Local<Object> buffer = pool->Wrap(isolate, baton->buffer, samples * frameAlignment, typedFormat);
+  baton->buffer = NULL;
   delete baton;
+  return buffer;
+}
+
+void Zipper::Enqueue(ZipBaton* baton) {
+  if (zipping) {
+    queue.push_back(baton);
+  } else {
+    zipping = true;
+    BeginZip(baton);
+  }
+}
+
+void Zipper::IsReady(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.Holder());
+  int channel = args[0]->Int32Value();
+  bool ready = channel >= 0 && channel < zip->channels &&
+      zip->fifos[channel]->Readable() >= static_cast<size_t>(zip->blockSamples * zip->alignment);
+  args.GetReturnValue().Set(Boolean::New(isolate, ready));
+}
+
+void Zipper::Release(const FunctionCallbackInfo<Value>& args) {
+  Isolate *isolate = args.GetIsolate();
+
+  REQUIRE_ARGUMENTS(isolate, 1);
+
+  Zipper* zip = ObjectWrap::Unwrap<Zipper>(args.Holder());
+  bool released = zip->pool->Release(isolate, args[0]);
+  args.GetReturnValue().Set(Boolean::New(isolate, released));
 }
 
 void Zipper::BeginZip(Baton* baton) {
-  uv_queue_work(uv_default_loop(), &baton->request, DoZip, (uv_after_work_cb)AfterZip);
+  QueueWork(baton->zip->loop, &baton->request, DoZip, AfterZip);
 }
 
 void Zipper::DoZip(uv_work_t* req) {
   ZipBaton* baton = static_cast<ZipBaton*>(req->data);
   Zipper* zip = baton->zip;
 
-  for (int sample = 0; sample < ZIP_BUFFER_SAMPLES; sample++) {
-    for (int channel = 0; channel < zip->channels; channel++) {
-      memcpy(
-        zip->buffer + (sample * zip->frameAlignment) + (channel * zip->alignment),
-        baton->channelData[channel] + (sample * zip->alignment),
-        zip->alignment
-      );
+  // Each channel may wrap around its FIFO at a different point, the block
+  // is zipped in as many runs as it takes to stay contiguous in all of them.
+  int done = 0;
+  while (done < baton->samples) {
+    int run = baton->samples - done;
+    for (int i = 0; i < zip->channels; i++) {
+      size_t pos = baton->starts[i] + done * zip->alignment;
+      baton->channelData[i] = zip->fifos[i]->At(pos);
+      int contiguous = zip->fifos[i]->Contiguous(pos) / zip->alignment;
+      if (contiguous < run) run = contiguous;
     }
+
+    zip->kernel(baton->channelData, baton->buffer + done * zip->frameAlignment, run, zip->channels, zip->alignment);
+    done += run;
   }
 }
 
-void Zipper::AfterZip(uv_work_t* req) {
-  Isolate *isolate = Isolate::GetCurrent();
-  HandleScope scope(isolate);
+void Zipper::AfterZip(uv_work_t* req, int status) {
   ZipBaton* baton = static_cast<ZipBaton*>(req->data);
-  Zipper* zip = baton->zip;
-
-  size_t blen = ZIP_BUFFER_SAMPLES * zip->frameAlignment;
-  MaybeLocal<Object> buffer = Buffer::New(isolate, zip->buffer, blen);
 
-  for (int i = 0; i < zip->channels; i++) {
-    zip->channelsReady.Get(isolate)->Set(i, Boolean::New(isolate, false));
+  if (status == UV_ECANCELED) {
+    delete baton;
+    return;
   }
 
-  for (int i = 0; i < zip->channels; i++) {
-    zip->channelBuffers.Get(isolate)->Set(i, Local<Value>::New(isolate, Null(isolate)));
+  Zipper* zip = baton->zip;
+  Isolate *isolate = zip->isolate;
+  HandleScope scope(isolate);
+
+  size_t blen = baton->samples * zip->frameAlignment;
+  Local<Object> buffer = zip->pool->Wrap(isolate, baton->buffer, blen, zip->typedFormat);
+  baton->buffer = NULL;
+
+  if (zip->queue.empty()) {
+    zip->zipping = false;
+  } else {
+    Baton* next = zip->queue.front();
+    zip->queue.pop_front();
+    BeginZip(next);
   }
 
-  zip->zipping = false;
   delete baton;
+  zip->Schedule();
 
   if (!zip->callback.IsEmpty()) {
-    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer.ToLocalChecked()) };
+    Local<Value> argv[2] = { Local<Value>::New(isolate, Null(isolate)), Local<Value>::New(isolate, buffer) };
     TRY_CATCH_CALL(isolate, zip->handle(), zip->callback, 2, argv);
   }
+
+  zip->End();
 }
\ No newline at end of file
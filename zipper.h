@@ -3,13 +3,21 @@
 
 #include <cstdlib>
 #include <cstring>
+#include <deque>
 #include <uv.h>
 #include <node.h>
 #include <node_buffer.h>
 #include <node_object_wrap.h>
 #include "macros.h"
+#include "pool.h"
+#include "worker.h"
+#include "interleave.h"
+#include "fifo.h"
 
 #define ZIP_BUFFER_SAMPLES 1024
+#define ZIP_QUEUE_SIZE 4
+#define ZIP_FIFO_BLOCKS 8
+#define ZIP_SYNC_SAMPLES 256
 
 using namespace v8;
 using namespace node;
@@ -23,21 +31,31 @@ public:
   static void Init(Handle<Object> exports);
 
 protected:
-  Zipper() : ObjectWrap(), channels(0), alignment(0), frameAlignment(0), zipping(false), buffer(NULL) {
-    channelBuffers.Reset();
-    channelsReady.Reset();
+  Zipper() : ObjectWrap(), pool(NULL), fifos(NULL), channels(0), blockSamples(0), alignment(0), frameAlignment(0), zipping(false), queueSize(0), syncBlocks(false), scheduling(false), flushing(false), ended(false), kernel(NULL), typedFormat(-1), isolate(NULL), loop(NULL) {
     callback.Reset();
   }
 
   ~Zipper() {
-    channels = 0;
+    RemoveQueueOwner(this);
+    blockSamples = 0;
     alignment = 0;
     frameAlignment = 0;
     zipping = false;
-    if (buffer != NULL) free(buffer);
-    buffer = NULL;
-    channelBuffers.Reset();
-    channelsReady.Reset();
+    queueSize = 0;
+    syncBlocks = false;
+    scheduling = false;
+    flushing = false;
+    ended = false;
+    kernel = NULL;
+    typedFormat = -1;
+    if (fifos != NULL) {
+      for (int i = 0; i < channels; i++) delete fifos[i];
+      free(fifos);
+    }
+    fifos = NULL;
+    channels = 0;
+    if (pool != NULL) pool->Destroy();
+    pool = NULL;
     callback.Reset();
   }
 
@@ -54,55 +72,72 @@ protected:
     }
   };
 
-  struct WriteBaton : Baton {
-    Persistent<Function> callback;
-    int channel;
-
-    WriteBaton(Isolate* isolate, Zipper* zip_, Handle<Function> cb_, int channel_) : Baton(zip_), channel(channel_) {
-      callback.Reset(isolate, cb_);
-    }
-    virtual ~WriteBaton() {
-      callback.Reset();
-    }
-  };
-
   struct ZipBaton : Baton {
-    char** channelData;
-
-    ZipBaton(Isolate* isolate, Zipper* zip_) : Baton(zip_), channelData(NULL) {
-      channelData = (char**)malloc(zip->channels * sizeof(char*));
+    const char** channelData;
+    size_t* starts;
+    char* buffer;
+    int samples;
+
+    ZipBaton(Zipper* zip_, int samples_) : Baton(zip_), channelData(NULL), starts(NULL), buffer(NULL), samples(samples_) {
+      channelData = (const char**)malloc(zip->channels * sizeof(char*));
+      starts = (size_t*)malloc(zip->channels * sizeof(size_t));
       for (int i = 0; i < zip->channels; i++) {
-        channelData[i] = Buffer::Data(zip->channelBuffers.Get(isolate)->Get(i)->ToObject());
+        starts[i] = zip->fifos[i]->Read(samples * zip->alignment);
       }
+
+      buffer = zip->pool->Acquire(samples * zip->frameAlignment);
     }
     virtual ~ZipBaton() {
+      for (int i = 0; i < zip->channels; i++) {
+        zip->fifos[i]->Release(samples * zip->alignment);
+      }
+      free(starts);
       free(channelData);
+      if (buffer != NULL) zip->pool->Recycle(buffer, samples * zip->frameAlignment);
     }
   };
 
   static void New(const FunctionCallbackInfo<Value>& args);
+  static void CancelQueued(void* arg);
   static void Write(const FunctionCallbackInfo<Value>& args);
-  static void ChannelBuffersGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void Flush(const FunctionCallbackInfo<Value>& args);
+  static void ZipSync(const FunctionCallbackInfo<Value>& args);
+  static void IsReady(const FunctionCallbackInfo<Value>& args);
   static void ChannelsReadyGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
   static void SamplesPerBufferGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
   static void ZippingGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
+  static void SaturatedGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
 
-  static void BeginWrite(Baton* baton);
-  static void DoWrite(uv_work_t* req);
-  static void AfterWrite(uv_work_t* req);
+  static void Release(const FunctionCallbackInfo<Value>& args);
+  static void PoolGetter(Local<String>, const PropertyCallbackInfo<Value>& args);
 
+  size_t Readable();
+  void Schedule();
+  void End();
+  Local<Object> ZipBlock(int samples);
+  void Enqueue(ZipBaton* baton);
   static void BeginZip(Baton* baton);
   static void DoZip(uv_work_t* req);
-  static void AfterZip(uv_work_t* req);
+  static void AfterZip(uv_work_t* req, int status);
 
-  Persistent<Array> channelBuffers;
-  Persistent<Array> channelsReady;
   Persistent<Function> callback;
+  BufferPool* pool;
+  Fifo** fifos;
   int channels;
+  int blockSamples;
   int alignment;
   int frameAlignment;
   bool zipping;
-  char* buffer;
+  std::deque<Baton*> queue;
+  int queueSize;
+  bool syncBlocks;
+  bool scheduling;
+  bool flushing;
+  bool ended;
+  InterleaveKernel kernel;
+  int typedFormat;
+  Isolate* isolate;
+  uv_loop_t* loop;
 };
 
 }